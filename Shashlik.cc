@@ -46,12 +46,23 @@
 #include <string>
 #include <vector>
 #include <ctime>
+#include <cstdio>
+#include <cstdlib>
 
 #include "TString.h"
+#include "TFile.h"
+#include "TTree.h"
 #include "TRandom3.h"
 #include "TCint.h"
 
-#include "G4RunManager.hh"
+#include "ShashlikRunManager.hh"
+#ifdef G4MULTITHREADED
+#include "G4MTRunManager.hh"
+#include "TThread.h"
+#else
+#include "SimulationServer.hh"
+#include "ParameterScan.hh"
+#endif
 #include "G4UImanager.hh"
 #include "G4PhysListFactory.hh"
 #include "G4EmUserPhysics.hh"
@@ -63,12 +74,15 @@
 
 #include "PrimaryGeneratorAction.hh"
 #include "DetectorConstruction.hh"
-#include "RunAction.hh"
-#include "TrackingAction.hh"
-#include "SteppingAction.hh"
-#include "EventAction.hh"
+#include "ActionInitialization.hh"
 #include "SteppingVerbose.hh"
 #include "CreateTree.hh"
+#include "OutputMerger.hh"
+#include "EventSeeder.hh"
+#include "Randomize.hh"
+#include "PhysicsTableCache.hh"
+#include "StartupProfiler.hh"
+#include "FiberLayout.hh"
 
 #ifdef G4VIS_USE
 #include "G4VisExecutive.hh"
@@ -81,34 +95,84 @@
 
 
 long int CreateSeed();
+bool MergeOutputs(const string& filename, const std::vector<TString>& partNames);
+void InitializeKernel(G4RunManager* runManager, PhysicsTableCache& tableCache);
+bool WriteStartupProfile(const string& filename);
+bool BenchmarkFiberLayout(const ConfigFile& config, double fiberRadius);
 
 
 
 int main(int argc,char** argv)
 {
+  StartupProfiler::BeginPhase("ROOT dictionaries");
   gInterpreter -> GenerateDictionary("vector<float>","vector");
+  StartupProfiler::EndPhase("ROOT dictionaries");
+  
+  
+  // Merge the outputs of jobs run separately
+  //
+  if (argc >= 4 && string(argv[1]) == "--merge")
+  {
+    bool renumber = (string(argv[2]) == "--renumber");
+    int firstInput = renumber ? 4 : 3;
+    std::vector<TString> inputNames;
+    for(int iArg = firstInput; iArg < argc; ++iArg)
+      inputNames.push_back(argv[iArg]);
+    
+    OutputMerger merger;
+    for(unsigned int iInput = 0; iInput < inputNames.size(); ++iInput)
+      merger.AddInput(inputNames.at(iInput));
+    merger.SetRenumber(renumber);
+    return merger.Merge(argv[firstInput-1]) ? 0 : 1;
+  }
   
+  // Time the computation of the fiber layout
+  //
+  if ((argc == 3 || argc == 4) && string(argv[2]) == "--layoutBenchmark")
+  {
+    ConfigFile config(argv[1]);
+    double fiberRadius = (argc == 4) ? atof(argv[3]) : 0.;
+    return BenchmarkFiberLayout(config, fiberRadius) ? 0 : 1;
+  }
   
-  if (argc != 3 && argc != 2)
+  bool serverMode = (argc == 4 && string(argv[2]) == "--server");
+  bool scanMode   = (argc == 5 && string(argv[2]) == "--scan");
+  if (argc != 3 && argc != 2 && !serverMode && !scanMode)
   {
-    cout << "Syntax for exec: crystal <configuration file> <output file>" << endl; 
-    cout << "Syntax for viz:  crystal <configuration file>" << endl; 
+    cout << "Syntax for exec:   crystal <configuration file> <output file>" << endl; 
+    cout << "Syntax for viz:    crystal <configuration file>" << endl; 
+    cout << "Syntax for server: crystal <configuration file> --server <FIFO>" << endl; 
+    cout << "Syntax for scan:   crystal <configuration file> --scan <scan file> <output file>" << endl; 
+    cout << "Syntax for merge:  crystal --merge [--renumber] <output file> <input files>" << endl; 
+    cout << "Syntax for layout benchmark: crystal <configuration file> --layoutBenchmark [fiber radius in mm]" << endl; 
     return 0;
   }
   
   string file;
   string filename;
-  TFile* outfile = NULL;
+  bool writeProfile = true;
   
-  if(argc == 3) 
+  if(serverMode || scanMode)
+  {
+#ifdef G4MULTITHREADED
+    cout << "Server and scan modes are only available in sequential builds" << endl;
+    return 1;
+#else
+    // a geometry loaded from GDML cannot follow the configuration changes of the runs
+    if(ConfigFile(argv[1]).read<string>("gdml_load", "") != "")
+    {
+      cout << "Server and scan modes cannot be used with gdml_load" << endl;
+      return 1;
+    }
+    cout << "Starting " << (serverMode ? "server" : "scan") << " mode..." << endl; 
+#endif
+  }
+  else if(argc == 3) 
   {
     cout << "Starting exec mode..." << endl; 
     file = argv[2];
     filename = file + ".root";
     G4cout << "Writing data to file '" << filename << "' ..." << G4endl;
-    
-    outfile = new TFile((TString)filename,"RECREATE");
-    outfile -> cd();
   }
   
   if (argc == 2)
@@ -130,7 +194,18 @@ int main(int argc,char** argv)
   cout<<"=====>   C O N F I G U R A T I O N   <====\n"<<endl;
   
   G4cout << "Configuration file: '" << argv[1] << "'" << G4endl;
+  StartupProfiler::BeginPhase("configuration");
   ConfigFile config(argv[1]);
+  StartupProfiler::EndPhase("configuration");
+  
+#ifdef G4MULTITHREADED
+  // the thread outputs have no checkpoints, a job asking for them would not be protected
+  if( config.read<int>("checkpointEvents", 0) > 0 )
+  {
+    G4cerr << "Checkpoints (checkpointEvents) are only available in sequential builds" << G4endl;
+    return 1;
+  }
+#endif
   
   
   // Seed the random number generator manually
@@ -142,20 +217,42 @@ int main(int argc,char** argv)
     myseed = CreateSeed();
   }
   G4cout << "Random seed : " << myseed << G4endl;
+  // an engine using both the seeds given to each event by the EventSeeder
+  CLHEP::HepRandom::setTheEngine(new CLHEP::RanecuEngine);
   CLHEP::HepRandom::setTheSeed(myseed);
+  // each event is then seeded from the master seed and its global number
+  EventSeeder::SetMasterSeed(myseed);
+  // jobs simulating a part of a larger sample start from their first event
+  ShashlikRunManager::SetFirstEvent(config.read<int>("firstEvent", 0));
   
   
   CreateTree* mytree = new CreateTree ("tree") ;
   
   
+  // Run manager
+  //
+#ifdef G4MULTITHREADED
+  // worker threads fill their own trees, ROOT has to be told
+  TThread::Initialize();
+  
+  G4int nThreads = config.read<int>("nThreads", 1);
+  G4cout << "Number of threads: " << nThreads << G4endl;
+  
+  G4MTRunManager* runManager = new G4MTRunManager;
+  runManager->SetNumberOfThreads(nThreads);
+  
+  // the stepping verbose of the workers is built by the ActionInitialization
+  G4VSteppingVerbose* verbosity = NULL;
+#else
   // User Verbose output class
   //
   G4VSteppingVerbose* verbosity = new SteppingVerbose;
   G4VSteppingVerbose::SetInstance(verbosity);
   
-  // Run manager
-  //
-  G4RunManager* runManager = new G4RunManager;
+  ShashlikRunManager* runManager = new ShashlikRunManager;
+  // the reference of the configurations of the server requests and of the scan points
+  runManager->SetConfig(config);
+#endif
   
   
   //Physics list defined using PhysListFactory
@@ -185,9 +282,11 @@ int main(int argc,char** argv)
   //
   
   G4cout << ">>> Define physics list::begin <<<" << G4endl; 
+  StartupProfiler::BeginPhase("physics list");
   G4VModularPhysicsList* physics = factory.GetReferencePhysList(physName);
-  physics->RegisterPhysics(new G4EmUserPhysics(0));
+  physics->RegisterPhysics(new G4EmUserPhysics(0, config));
   runManager-> SetUserInitialization(physics);
+  StartupProfiler::EndPhase("physics list");
   G4cout << ">>> Define physics list::end <<<" << G4endl; 
   
   G4cout << ">>> Define DetectorConstruction::begin <<<" << G4endl; 
@@ -195,34 +294,22 @@ int main(int argc,char** argv)
   runManager-> SetUserInitialization(detector);
   G4cout << ">>> Define DetectorConstruction::end <<<" << G4endl; 
   
-  G4cout << ">>> Define PrimaryGeneratorAction::begin <<<" << G4endl; 
-  G4ThreeVector posCentre(0.*m,0.*m,-1.*(detector->GetModule_z()/m)/2.*m);
-  G4VUserPrimaryGeneratorAction* gen_action = new PrimaryGeneratorAction(posCentre);
-  runManager->SetUserAction(gen_action);
-  G4cout << ">>> Define PrimaryGeneratorAction::end <<<" << G4endl; 
+  // Physics tables from the cache, when built already for the same materials and cuts,
+  // looked up once the kernel is initialized
+  //
+  PhysicsTableCache tableCache(config.read<string>("physicsTableCache", ""), physName, physics);
   
   // UserAction classes
   //
   
-  G4cout << ">>> Define RunAction::begin <<<" << G4endl; 
-  G4UserRunAction* run_action = new RunAction;
-  runManager->SetUserAction(run_action);  
-  G4cout << ">>> Define RunAction::end <<<" << G4endl; 
-  
-  G4cout << ">>> Define EventAction::begin <<<" << G4endl; 
-  G4UserEventAction* event_action = new EventAction;
-  runManager->SetUserAction(event_action);
-  G4cout << ">>> Define EventAction::end <<<" << G4endl; 
-  
-  G4cout << ">>> Define TrackingAction::begin <<<" << G4endl; 
-  TrackingAction* tracking_action = new TrackingAction;
-  runManager->SetUserAction(tracking_action); 
-  G4cout << ">>> Define TrackingAction::end <<<" << G4endl;
-  
-  G4cout << ">>> Define SteppingAction::begin <<<" << G4endl; 
-  SteppingAction* stepping_action = new SteppingAction;
-  runManager->SetUserAction(stepping_action); 
-  G4cout << ">>> Define SteppingAction::end <<<" << G4endl;
+  G4ThreeVector posCentre(0.*m,0.*m,-1.*(detector->GetModule_z()/m)/2.*m);
+#ifdef G4MULTITHREADED
+  // each worker thread writes its own output segment
+  runManager->SetUserInitialization(new ActionInitialization(config, posCentre, file));
+#else
+  ActionInitialization actions(config, posCentre);
+  actions.Build();
+#endif
   
   
   if (argc == 2)   // Define UI session for interactive mode
@@ -230,6 +317,7 @@ int main(int argc,char** argv)
     // Initialize G4 kernel
     //
     runManager -> Initialize();
+    tableCache.Retrieve();
     
     #ifdef G4VIS_USE
     G4VisManager* visManager = new G4VisExecutive;
@@ -250,9 +338,97 @@ int main(int argc,char** argv)
     delete visManager;
     #endif  
   }
+#ifndef G4MULTITHREADED
+  else if (serverMode)   // Serve run requests until told to quit
+  {
+    InitializeKernel(runManager, tableCache);
+    
+    SimulationServer server(runManager, mytree, argv[3]);
+    G4int nFailed = server.Serve();
+    
+    delete runManager;
+    delete verbosity;
+    return nFailed == 0 ? 0 : 1;
+  }
+  else if (scanMode)   // Run the macro at each point of the parameter scan
+  {
+    InitializeKernel(runManager, tableCache);
+    
+    ParameterScan scan(runManager, mytree, config);
+    filename = string(argv[4]) + ".root";
+    G4bool success = scan.ReadPoints(argv[3]) && mytree -> OpenFile(filename);
+    if( success )
+    {
+      G4cout << "Writing data to file '" << filename << "' ..." << G4endl;
+      success = scan.Run("gps.mac");
+      mytree -> CloseFile();
+      WriteStartupProfile(filename);
+    }
+    
+    delete runManager;
+    delete verbosity;
+    return success ? 0 : 1;
+  }
+#endif
   else
   {
-    runManager -> Initialize();
+    InitializeKernel(runManager, tableCache);
+    
+#ifndef G4MULTITHREADED
+    // Fork the workers after the initialization
+    //
+    G4int nForks = config.read<int>("nForks", 1);
+    if( nForks > 1 )
+    {
+      // the physics tables are already built, all the workers share them
+      G4int worker = runManager -> ForkWorkers(nForks);
+      if( worker < 0 )
+      {
+        G4bool success = runManager -> WaitForWorkers();
+        
+        delete runManager;
+        delete verbosity;
+        
+        std::vector<TString> partNames;
+        for(G4int iWorker = 0; iWorker < nForks; ++iWorker)
+          partNames.push_back(file + Form("_part%d.root", iWorker));
+        
+        if( !success || !MergeOutputs(filename, partNames) ) return 1;
+        WriteStartupProfile(filename);
+        return 0;
+      }
+      
+      // each worker writes its own part of the output, the startup profile goes to the merged one
+      writeProfile = false;
+      filename = file + Form("_part%d.root", worker);
+      G4cout << "Worker " << worker << ": writing data to file '" << filename << "' ..." << G4endl;
+    }
+    
+    // go on from the last checkpoint of an interrupted job with the same seed
+    mytree -> SetCheckpointInterval(config.read<int>("checkpointEvents", 0));
+    Long64_t checkpointSeed = 0, eventsDone = 0;
+    Long64_t eventsResumed = -1;
+    if( CreateTree::ReadCheckpoint(filename, checkpointSeed, eventsDone) )
+    {
+      G4long configSeed = config.read<long int>("seed");
+      if( configSeed != -1 && configSeed != checkpointSeed )
+        G4cerr << "Checkpoint of '" << filename << "' made with seed " << checkpointSeed 
+               << ", starting over with seed " << configSeed << G4endl;
+      else
+        eventsResumed = mytree -> ResumeFile(filename);
+    }
+    if( eventsResumed >= 0 )
+    {
+      G4cout << "Resuming '" << filename << "' after " << eventsResumed << " events" << G4endl;
+      EventSeeder::SetMasterSeed(checkpointSeed);
+      runManager -> SkipEvents(eventsResumed);
+    }
+    else
+      mytree -> OpenFile(filename);
+#endif
+    
+    // the phase is closed by the RunAction, at the beginning of the run
+    StartupProfiler::BeginPhase("GPS macro");
     G4UImanager* UImanager = G4UImanager::GetUIpointer(); 
     UImanager -> ApplyCommand("/control/execute gps.mac");
   } 
@@ -267,10 +443,16 @@ int main(int argc,char** argv)
   
   if(argc == 3) 
   {
+#ifdef G4MULTITHREADED
+    // events are distributed dynamically among the threads, the merge indexes them by number
+    if( !MergeOutputs(filename, CreateTree::CloseWorkers()) ) return 1;
+    WriteStartupProfile(filename);
+#else
     G4cout << "Writing tree to file " << filename << " ..." << G4endl;
-    
-    mytree -> GetTree() -> Write();
-    outfile -> Close();
+    mytree -> CloseFile();
+    if( writeProfile ) WriteStartupProfile(filename);
+    else StartupProfiler::Print(G4cout);
+#endif
   }
   
   return 0;
@@ -278,6 +460,100 @@ int main(int argc,char** argv)
 
 
 
+bool MergeOutputs(const string& filename, const std::vector<TString>& partNames)
+{
+  OutputMerger merger;
+  for(unsigned int iPart = 0; iPart < partNames.size(); ++iPart)
+    merger.AddInput(partNames.at(iPart));
+  merger.SetRemoveInputs(true);
+  return merger.Merge(filename);
+}
+
+
+
+// Initialize the kernel and build the physics tables before the first run,
+// so that they can be added to the cache and shared by forked workers;
+// the cache is looked up after the initialization, once the cuts are set
+void InitializeKernel(G4RunManager* runManager, PhysicsTableCache& tableCache)
+{
+  StartupProfiler::BeginPhase("run manager initialization");
+  runManager -> Initialize();
+  StartupProfiler::EndPhase("run manager initialization");
+  
+  StartupProfiler::BeginPhase("physics tables");
+  tableCache.Retrieve();
+  runManager -> BeamOn(0);
+  tableCache.Store();
+  StartupProfiler::EndPhase("physics tables");
+}
+
+
+
+// Print the startup profile and add it to the output file
+bool WriteStartupProfile(const string& filename)
+{
+  StartupProfiler::Print(G4cout);
+  
+  TFile outfile(filename.c_str(), "UPDATE");
+  if( outfile.IsZombie() ) return false;
+  TTree* profile = StartupProfiler::MakeTree();
+  outfile.cd();
+  profile -> Write();
+  outfile.Close();
+  delete profile;
+  return true;
+}
+
+
+
+// The layout of the module of the configuration, with the given fiber radius or,
+// if not given, with the configured one halved until there are at least 10^5 fibers.
+// The layout is computed again until 1 s of CPU time is spent.
+bool BenchmarkFiberLayout(const ConfigFile& config, double fiberRadius)
+{
+  double module_xy = config.read<double>("module_xy");
+  double chamfer   = config.read<double>("chamfer");
+  FiberLayout layout(FiberLayout::MakeOctagon(0.5*module_xy, chamfer));
+  
+  if( fiberRadius <= 0. )
+  {
+    fiberRadius = config.read<double>("fiberClad_radius");
+    while( true )
+    {
+      layout.SetDefaultPolicies(fiberRadius);
+      if( layout.Compute().size() >= 100000 || fiberRadius < 1.e-6 ) break;
+      fiberRadius *= 0.5;
+    }
+  }
+  if( fiberRadius <= 0. ) return false;
+  layout.SetDefaultPolicies(fiberRadius);
+  
+  int nLayouts = 0;
+  clock_t start = clock();
+  double cpuTime = 0.;
+  while( cpuTime < 1. || nLayouts < 5 )
+  {
+    layout.Compute();
+    ++nLayouts;
+    cpuTime = double(clock() - start) / CLOCKS_PER_SEC;
+  }
+  
+  const std::vector<FiberLayout::Fiber>& fibers = layout.GetFibers();
+  int nFibersInChamfer[FiberLayout::kNChamfers] = {0, 0, 0, 0};
+  for(unsigned int iFiber = 0; iFiber < fibers.size(); ++iFiber)
+    ++nFibersInChamfer[fibers[iFiber].chamfer];
+  
+  cout << ">>> FiberLayout benchmark: module " << module_xy << " mm, chamfer " << chamfer
+       << " mm, fiber radius " << fiberRadius << " mm <<<" << endl;
+  for(int iChamfer = 0; iChamfer < FiberLayout::kNChamfers; ++iChamfer)
+    cout << "    chamfer " << iChamfer << ": " << nFibersInChamfer[iChamfer] << " fibers" << endl;
+  cout << "    " << fibers.size() << " fibers in " << 1000. * cpuTime / nLayouts << " ms per layout, "
+       << nLayouts << " layouts, " << 1.e9 * cpuTime / nLayouts / fibers.size() << " ns per fiber" << endl;
+  return true;
+}
+
+
+
 long int CreateSeed()
 {
   TRandom3 rangen;
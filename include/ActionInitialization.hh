@@ -0,0 +1,52 @@
+// Builds the user actions of the simulation.
+// In a multi-threaded Geant4 build this is a G4VUserActionInitialization:
+// Build () is called once per worker thread, so that each worker gets its own
+// action instances and its own CreateTree, while BuildForMaster () only
+// provides the master RunAction.
+// In a sequential build the same class just registers the actions
+// to the G4RunManager, so that the two modes share one list of actions.
+
+#ifndef ActionInitialization_h
+#define ActionInitialization_h 1
+
+#include "globals.hh"
+#include "ConfigFile.hh"
+#include "G4ThreeVector.hh"
+#include "G4RunManager.hh"
+
+#ifdef G4MULTITHREADED
+#include "G4VUserActionInitialization.hh"
+#endif
+
+
+
+#ifdef G4MULTITHREADED
+class ActionInitialization : public G4VUserActionInitialization
+#else
+class ActionInitialization
+#endif
+{
+public:
+  ActionInitialization  (const ConfigFile& config, const G4ThreeVector& posCentre, const G4String& outputName = "") ;
+  ~ActionInitialization () ;
+
+  virtual void Build () const ;
+
+#ifdef G4MULTITHREADED
+  virtual void BuildForMaster () const ;
+  virtual G4VSteppingVerbose* InitializeSteppingVerbose () const ;
+#else
+private:
+  template <class T> void SetUserAction (T* action) const
+  {
+    G4RunManager::GetRunManager ()->SetUserAction (action) ;
+  }
+#endif
+
+private:
+  ConfigFile    fConfig ;          // for the options of the actions
+  G4ThreeVector fPosCentre ;
+  G4String      fOutputName ;     // base name of the output files of the worker threads
+} ;
+
+#endif
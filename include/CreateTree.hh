@@ -1,11 +1,17 @@
 #include <iostream>
 #include <vector>
-#include <map>
 
 #include "TFile.h"
 #include "TTree.h"
 #include "TString.h"
 
+#include "globals.hh"
+
+// G4ThreadLocal is only provided by multi-threaded capable Geant4 versions
+#ifndef G4ThreadLocal
+#define G4ThreadLocal
+#endif
+
 
 
 class CreateTree
@@ -14,13 +20,31 @@ private:
   
   TTree*  ftree ;
   TString fname ;
-  std::map <int, std::pair<int, float> > fsingleGammaInfo ;
-  //        photonID       chamferID  lengthInChamfer 
-  // lengthInChamfer is redundant
+  TFile*  ffile ;                               // output file, if owned by the tree
+  int     fcheckpointInterval ;                 // events between checkpoints, 0 for none
+  int     feventsSinceCheckpoint ;
+  struct PhotonInfo
+  {
+    int   chamfer ;             // chamfer and fiber where the photon was first seen, -1 if not seen
+    int   fiber ;
+    float length ;              // redundant
+  } ;
+  // indexed by track ID, which Geant4 assigns densely within an event:
+  // grows with the largest ID seen and is kept across events
+  std::vector<PhotonInfo> fsingleGammaInfo ;
+  std::vector<int>        fphotonsSeen ;        // track IDs of the photons seen in the event
+  
+  // per fiber sums of the event, for all the fibers, and list of the fibers hit
+  std::vector<int>   ffiberPhotons ;
+  std::vector<float> ffiberPhLength ;
+  std::vector<bool>  ffiberIsHit ;
+  std::vector<int>   ffibersHit ;
+  
+  static std::vector<CreateTree*> fWorkers ;   // trees filled by the worker threads
   
 public:
   
-  CreateTree (TString name) ;
+  CreateTree (TString name, bool registerInstance = true) ;
   ~CreateTree () ;
   
   TTree*             GetTree  () const { return ftree ; } ;
@@ -30,13 +54,63 @@ public:
   void               Clear    () ;
   static CreateTree* Instance () { return fInstance ; } ;
   
-  // feed the info of each single photon to the tree
-  void               addPhoton (int trackId, float length, int chamferId) ;
-
-  static CreateTree* fInstance ;
+  // allocate the per fiber sums for a geometry with nFibers fibers
+  void               ReserveFibers (int nFibers) ;
+  // one entry of depositInLayer per layer of the geometry, all set to zero
+  void               SetLayers (int nLayers) { depositInLayer->assign (nLayers, 0.) ; } ;
+  void               AddLayerDeposit (int layer, float energy)
+    {
+      if (layer >= int (depositInLayer->size ())) depositInLayer->resize (layer + 1, 0.) ;
+      (*depositInLayer)[layer] += energy ;
+    } ;
+  // feed the info of each single photon, with its weight, to the tree;
+  // returns true the first time the photon is seen
+  bool               addPhoton (int trackId, float length, int chamferId, int fiberId, float weight = 1.) ;
+  
+  // direct the tree to an output file of its own, or write and close it,
+  // together with the master seed of the job
+  bool               OpenFile  (TString fileName) ;
+  bool               CloseFile () ;
+  // write an object next to the tree in the output file
+  bool               WriteObject (TObject* object) ;
+  
+  // checkpoints: every nEvents the tree is saved to the output file together
+  // with a <output file>.checkpoint file, so that an interrupted job can go on
+  void               SetCheckpointInterval (int nEvents) { fcheckpointInterval = nEvents ; } ;
+  bool               Checkpoint () ;
+  // master seed and events saved by the checkpoint of an output file, false if there is none
+  static bool        ReadCheckpoint (TString fileName, Long64_t& masterSeed, Long64_t& eventsDone) ;
+  // go on filling the tree saved in an output file by the last checkpoint,
+  // returns the number of events in it, -1 if it cannot be resumed
+  Long64_t           ResumeFile (TString fileName) ;
+  
+  // read the entries of an existing tree into the variables of this one
+  void               Attach    (TTree* tree) ;
+  
+  // multi-threaded mode: book the tree of the calling worker thread in its own file
+  static CreateTree*          CreateWorker (TString name, TString fileName) ;
+  // write and close the worker files, returns their names
+  static std::vector<TString> CloseWorkers () ;
+  
+  static G4ThreadLocal CreateTree* fInstance ;
   
   int Event ;
-  float totalPhLengthInChamfer[4] ;           // total photons length in chamfers
+  Long64_t Seed ;                             // random seeds of the event, the two given to the engine
+  Long64_t Seed2 ;
+  int   ScanPoint ;                           // index of the parameter scan point, kept across events
+  float ScintFraction ;                       // fraction of the scintillation photons generated, kept across events
+  float totalPhLengthInChamfer[4] ;           // total photons length in chamfers, weighted
   int   numPhotonsInChamfer[4] ;              // number of photons in chamfers
+  float weightedPhotonsInChamfer[4] ;         // sum of the weights of the photons in chamfers
+  float fastPhLengthInChamfer[4] ;            // validation of the fiber fast simulation: predicted length
+  int   numFastPhotonsInChamfer[4] ;          // and number of photons trapped in chamfers
+  int   numPhotonsKilled[3] ;                 // optical photons killed by the limits on time, length, steps
+  
+  // fibers hit in the event only, sorted by fiber index (the copy number of the fiber volumes)
+  std::vector<int>*   fiberIndex ;
+  std::vector<int>*   fiberPhotons ;            // number of photons first seen in the fiber
+  std::vector<float>* fiberPhLength ;           // total photons length in the fiber, weighted
+  
+  std::vector<float>* depositInLayer ;          // energy deposited in the crystal of each layer, in MeV
 
 } ;
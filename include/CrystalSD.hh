@@ -0,0 +1,30 @@
+// Sensitive detector of the crystals, used by the fast mode of the light
+// collection table: at each step with energy deposit in a crystal the number
+// of scintillation photons is sampled as the scintillation process would,
+// and shared among the chamfers with the table probabilities for the position
+// of the step; the photons of each chamfer are added to numPhotonsInChamfer,
+// with unit weight, since no scintillation thinning is needed here.
+// The optical photons created in the crystals are killed by the StackingAction.
+
+#ifndef CrystalSD_h
+#define CrystalSD_h 1
+
+#include "globals.hh"
+#include "G4VSensitiveDetector.hh"
+
+class G4Step ;
+class G4TouchableHistory ;
+class LightCollectionTable ;
+
+
+
+class CrystalSD : public G4VSensitiveDetector
+{
+public:
+  CrystalSD  (const G4String& name) ;
+  ~CrystalSD () ;
+  
+  virtual G4bool ProcessHits (G4Step* step, G4TouchableHistory* history) ;
+} ;
+
+#endif
@@ -37,8 +37,10 @@
 #include <string>
 #include <fstream>
 #include <utility>
+#include <vector>
 
 #include "ConfigFile.hh"
+#include "FiberVolumeTable.hh"
 #include "TString.h"
 
 #include "globals.hh"
@@ -58,6 +60,7 @@
 #include "G4SubtractionSolid.hh"
 #include "G4Tubs.hh"
 #include "G4VisAttributes.hh"
+#include "G4VTouchable.hh"
 #include "G4VUserDetectorConstruction.hh"
 #include "G4Material.hh"
 #include "G4MaterialTable.hh"
@@ -65,6 +68,8 @@
 #include "G4ElementTable.hh"
 #include "G4TwoVector.hh"
 
+class FiberParameterisation ;
+
 
 
 class DetectorConstruction : public G4VUserDetectorConstruction
@@ -78,17 +83,33 @@ public:
   G4double GetModule_y () const { return module_y ; } ;
   G4double GetModule_z () const { return module_z ; } ;
   
-  void fillPolygon (std::vector<G4TwoVector>& theBase, const float& side, const float& chamfer) ;
+  // the fiber volumes of the current geometry, rebuilt by Construct ()
+  const FiberVolumeTable* GetFiberTable () const { return &fFiberTable ; } ;
+  G4int    GetNLayers  () const { return nLayers_z ; } ;
+  
+  // the crystal volume, placed once in the replicated layer
+  const G4VPhysicalVolume* GetCrystalPV () const { return fCrystalPV ; } ;
+  // layer of a point in a crystal, from its volume and touchable, -1 outside of the crystals
+  G4int GetCrystalLayer (const G4VPhysicalVolume* volume, const G4VTouchable* touchable) const
+    {
+      if (volume != fCrystalPV || !touchable) return -1 ;
+      return touchable->GetReplicaNumber (1) ;
+    } ;
   
-  std::pair<G4TwoVector,G4TwoVector> getChamfer  (std::vector<G4TwoVector>& theBase, const int& index) ;
-  G4TwoVector centerOfTheFirstFiber              (std::pair<G4TwoVector,G4TwoVector>& theChamfer, const int& fibresNumberInRow, const float& fiberExternalRadius, const int& numberOfRadius) ;
-  G4TwoVector centerOfTheFirstFiberPG            (std::pair<G4TwoVector,G4TwoVector>& theChamfer, const int& fibresNumberInRow, const float& fiberExternalRadius) ;
-  G4TwoVector getNextCenter                      (std::pair<G4TwoVector,G4TwoVector>& theChamfer, G4TwoVector& thisCenter, const float& fiberExternalRadius) ;
-  G4TwoVector centerOfTheFirstFibreOnSecondLayer (std::pair<G4TwoVector, G4TwoVector> & theChamfer, const float & fiberExternalRadius, G4TwoVector previousLayerStart) ;
-  bool checkIfOutOfChamfer                       (double radius, G4TwoVector centre, std::vector<G4TwoVector> solid, int chamferIndex) ;
+  // what a new configuration invalidates
+  enum { kNothingChanged = 0, kGeometryChanged = 1, kMaterialsChanged = 2, kOpticsChanged = 4 } ;
+  G4int UpdateConfig (const ConfigFile& config) ;
+  // true for the keys UpdateConfig applies, the others are only read at construction
+  static G4bool IsUpdatable (const std::string& key) ;
+  
+  void fillPolygon (std::vector<G4TwoVector>& theBase, const float& side, const float& chamfer) ;
   
 public:
   G4VPhysicalVolume* Construct () ;
+  // the sensitive detector and the fast simulation model of the fiber cores, in each thread
+  void ConstructSDandField () ;
+  // detach the volumes from the regions before they are deleted for a rebuild
+  void ReleaseRegions () ;
   
 private:
   G4VPhysicalVolume* fAbsorberPV ;      // the absorber physical volume
@@ -96,9 +117,14 @@ private:
 //  G4VPhysicalVolume* fFiberCorePV[4][100] ;   // the fiber physical volume
 //  G4VPhysicalVolume* fFiberCladPV[4][100] ;   // the fiber physical volume
 
-  std::vector <std::vector <G4VPhysicalVolume*> > fFiberCoreInsPV ;   // the fiber physical volume
-  std::vector <std::vector <G4VPhysicalVolume*> > fFiberCoreOutPV ;   // the fiber physical volume
-  std::vector <std::vector <G4VPhysicalVolume*> > fFiberCladPV ;      // the fiber physical volume
+  FiberVolumeTable fFiberTable ;
+  std::vector<G4LogicalVolume*> fFiberCoreLV ;   // the logical volumes of the fiber cores
+  std::vector<FiberParameterisation*> fFiberParameterisations ;   // one per chamfer, not owned by the volumes
+  
+  void placeFiber (const G4TwoVector& position, const int& chamfer) ;
+  void placeFiberBundle (const int& chamfer, const G4TwoVector& direction,
+                         G4LogicalVolume* coreInsLV, G4LogicalVolume* coreOutLV, G4LogicalVolume* cladLV,
+                         G4LogicalVolume* motherLV, const G4String& name) ;
   
   G4double  expHall_x ;
   G4double  expHall_y ;
@@ -127,13 +153,34 @@ private:
   G4int    fiberClad_material ;
   G4double fiberClad_radius ;
   G4double fiber_length ;
+  G4int    fiberFastSim ;      // 0) full tracking 1) analytic transport in the cores 2) validation of it
+  std::string fiberLayout_cache ;   // directory of the fiber layout files, see FiberLayoutCache
+  
+  std::string gdml_export ;   // file where the built world is written, if it does not exist yet
+  std::string gdml_load ;     // file the world is read from instead of building it
+  
+  G4int            lightTable_mode ;   // 0) off 1) calibration 2) fast, see LightCollectionTable
+  std::string      lightTable_dir ;
+  std::vector<int> lightTable_bins ;
   
   G4double depth ;
   
-  void readConfigFile (string configFileName) ;
+  void readConfig (const ConfigFile& config) ;
+  void constructLightTable () ;
+  void constructFiberRegion () ;
+  void exportGDML (const G4VPhysicalVolume* worldPV) const ;
+  G4VPhysicalVolume* loadGDML () ;
+  void computeDimensions () ;
+  
+  // the parameters each part of the detector description depends on
+  std::vector<G4double> materialParameters () const ;
+  std::vector<G4double> opticsParameters   () const ;
+  std::vector<G4double> geometryParameters () const ;
   
   //Materials
   void initializeMaterials () ;
+  void setScintillatorProperties () ;
+  G4Material* AirMaterial ;
   G4Material* AbMaterial ;
   G4Material* ScMaterial ;
   G4Material* CoMaterial ;
@@ -0,0 +1,32 @@
+// Random seeding of each event from the master seed of the job
+// and the global event number, so that any event can be reproduced
+// independently of the process or thread that simulates it,
+// and of the events simulated before.
+// Each event gets two independent seeds, meant for the RanecuEngine
+// installed by the main program, which uses both of them.
+
+#ifndef EventSeeder_h
+#define EventSeeder_h 1
+
+#include "globals.hh"
+
+
+
+class EventSeeder
+{
+public:
+  static void   SetMasterSeed (G4long seed) { fMasterSeed = seed ; } ;
+  static G4long GetMasterSeed ()            { return fMasterSeed ; } ;
+  // a master seed for the part index of a job that simulates independent samples
+  static G4long DerivedSeed (G4long masterSeed, G4long index) ;
+  
+  // seed index (0 or 1) of the event with global number eventNumber, both are stored in the tree
+  static G4long EventSeed (G4long eventNumber, G4int index = 0) ;
+  // reset the random engine of the calling thread for the event eventNumber
+  static void   SeedEvent (G4long eventNumber) ;
+  
+private:
+  static G4long fMasterSeed ;
+} ;
+
+#endif
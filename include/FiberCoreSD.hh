@@ -0,0 +1,33 @@
+// Sensitive detector of the fiber cores.
+// The kernel calls it only for the steps that start in a fiber core,
+// the optical photons that stay within the cores are accounted for in the
+// per fiber sums of CreateTree, which are allocated once for all the fibers
+// of the geometry and reset at each event.
+
+#ifndef FiberCoreSD_h
+#define FiberCoreSD_h 1
+
+#include "globals.hh"
+#include "G4VSensitiveDetector.hh"
+
+class G4Step ;
+class G4HCofThisEvent ;
+class G4TouchableHistory ;
+class FiberVolumeTable ;
+
+
+
+class FiberCoreSD : public G4VSensitiveDetector
+{
+public:
+  FiberCoreSD  (const G4String& name, const FiberVolumeTable* fiberTable) ;
+  ~FiberCoreSD () ;
+  
+  virtual void   Initialize  (G4HCofThisEvent* HCE) ;
+  virtual G4bool ProcessHits (G4Step* step, G4TouchableHistory* history) ;
+  
+private:
+  const FiberVolumeTable* fFiberTable ;
+} ;
+
+#endif
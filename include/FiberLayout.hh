@@ -0,0 +1,91 @@
+// Positions of the fibers in the four chamfers of the module.
+// The layout is computed in one pass from the octagonal section of the crystals,
+// with a packing policy and a fiber radius for each chamfer, and is returned
+// as a flat array of (x, y, radius, chamfer), the fibers of a chamfer
+// one after the other and the chamfers in order. It does not depend on the
+// rest of the detector description, so that it can be used as well by the
+// analysis and readout code to know where each fiber is.
+
+#ifndef FiberLayout_h
+#define FiberLayout_h 1
+
+#include <vector>
+
+#include "globals.hh"
+#include "G4TwoVector.hh"
+
+
+
+class FiberLayout
+{
+public:
+  enum Policy
+  {
+    kEmpty       = 0,   // no fibers
+    kRows        = 1,   // rows parallel to the chamfer, each one two radii further out and shorter
+    kSingleRow   = 2,   // a single row along the chamfer
+    kHexagonal   = 3,   // the most compact disposition, rows shifted by one radius
+    kSingleLarge = 4    // a single fiber in the middle of the chamfer
+  } ;
+  
+  struct Fiber
+  {
+    G4double x ;
+    G4double y ;
+    G4double radius ;   // outer, of the cladding
+    G4int    chamfer ;
+    G4int    unused ;   // explicit padding, the array is written as it is by FiberLayoutCache
+  } ;
+  
+  static const G4int kNChamfers = 4 ;
+  
+  // the octagon as built by MakeOctagon, counter-clockwise, each chamfer from vertex 2*i to 2*i+1
+  FiberLayout  (const std::vector<G4TwoVector>& octagon) ;
+  ~FiberLayout () {} ;
+  
+  // the section of the crystals: a square of half side halfSide with corners cut by chamfers of the given length
+  static std::vector<G4TwoVector> MakeOctagon (G4double halfSide, G4double chamfer) ;
+  
+  void SetPolicy (G4int chamfer, Policy policy, G4double radius) ;
+  // the layout of the module: rows, single row, hexagonal, and a large fiber
+  // as big as it fits in the last chamfer, the others with the given radius
+  void SetDefaultPolicies (G4double fiberRadius) ;
+  
+  Policy   GetPolicy (G4int chamfer) const { return fPolicies[chamfer] ; } ;
+  G4double GetRadius (G4int chamfer) const { return fRadii[chamfer] ; } ;
+  // unit vector along the chamfer, from its first to its second vertex
+  G4TwoVector GetDirection (G4int chamfer) const ;
+  
+  const std::vector<Fiber>& Compute () ;
+  const std::vector<Fiber>& GetFibers () const { return fFibers ; } ;
+  
+private:
+  // a chamfer with its unit vectors along it and towards the outside of the octagon
+  struct Frame
+  {
+    G4int       chamfer ;
+    G4TwoVector first ;
+    G4TwoVector second ;
+    G4TwoVector direction ;
+    G4TwoVector outward ;
+    G4double    length ;
+  } ;
+  
+  Frame MakeFrame (G4int chamfer) const ;
+  void  Add (const Frame& frame, const G4TwoVector& position, G4double radius) ;
+  
+  void FillRows        (const Frame& frame, G4double radius) ;
+  void FillSingleRow   (const Frame& frame, G4double radius) ;
+  void FillHexagonal   (const Frame& frame, G4double radius) ;
+  void FillSingleLarge (const Frame& frame, G4double radius) ;
+  
+  // whether a fiber does not cross the sides next to the chamfer
+  G4bool IsWithinSides (const Frame& frame, const G4TwoVector& centre, G4double radius) const ;
+  
+  std::vector<G4TwoVector> fOctagon ;
+  Policy   fPolicies[kNChamfers] ;
+  G4double fRadii[kNChamfers] ;
+  std::vector<Fiber> fFibers ;
+} ;
+
+#endif
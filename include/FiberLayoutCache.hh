@@ -0,0 +1,74 @@
+// On-disk cache of the fiber layout.
+// The layout computed by FiberLayout is stored in a binary file of the cache
+// directory named after a hash of the parameters it depends on, module_xy,
+// chamfer and the radii of the fiber cladding and core, and memory-mapped by
+// the following jobs with the same parameters instead of being computed again.
+// The parameters are stored in the file and checked before using it, so that
+// a hash collision cannot load the wrong layout.
+// The file can be read as well by the analysis code, to know the position of
+// each fiber from its index. It is made of, in the byte order of the machine:
+//   a header: char[8] "SHFIBLAY", int32 version, int32 number of fibers,
+//             double module_xy, chamfer, cladding radius, core radius (mm)
+//   the fibers, in the order of their index: double x, y, radius (mm), int32 chamfer, int32 unused
+
+#ifndef FiberLayoutCache_h
+#define FiberLayoutCache_h 1
+
+#include <string>
+#include <vector>
+
+#include "globals.hh"
+#include "FiberLayout.hh"
+
+
+
+class FiberLayoutCache
+{
+public:
+  // an empty cacheDir disables the cache
+  FiberLayoutCache  (const std::string& cacheDir, G4double module_xy, G4double chamfer,
+                     G4double cladRadius, G4double coreRadius) ;
+  ~FiberLayoutCache () ;
+  
+  G4bool IsEnabled () const { return fCacheDir != "" ; } ;
+  std::string GetFileName () const ;
+  
+  // maps the layout of these parameters, returns false if it is not in the cache
+  G4bool Map () ;
+  // maps a layout file, whatever its parameters
+  G4bool MapFile (const std::string& fileName) ;
+  // adds a layout computed for these parameters to the cache
+  G4bool Store (const std::vector<FiberLayout::Fiber>& fibers) const ;
+  
+  // the mapped fibers, valid as long as this object exists
+  G4int GetNFibers () const { return fNFibers ; } ;
+  const FiberLayout::Fiber* GetFibers () const { return fFibers ; } ;
+  
+private:
+  struct Header
+  {
+    char     magic[8] ;
+    G4int    version ;
+    G4int    nFibers ;
+    G4double module_xy ;
+    G4double chamfer ;
+    G4double cladRadius ;
+    G4double coreRadius ;
+  } ;
+  
+  void MakeHeader (Header& header, G4int nFibers) const ;
+  void Unmap () ;
+  
+  std::string fCacheDir ;
+  G4double    fModule_xy ;
+  G4double    fChamfer ;
+  G4double    fCladRadius ;
+  G4double    fCoreRadius ;
+  
+  void*       fMapping ;
+  size_t      fMappingSize ;
+  G4int       fNFibers ;
+  const FiberLayout::Fiber* fFibers ;
+} ;
+
+#endif
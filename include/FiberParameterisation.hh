@@ -0,0 +1,34 @@
+// Positions of the fibers of a bundle, all parallel to the z axis.
+// The cladding of the fibers of a chamfer is a single G4PVParameterised,
+// whose copy number is the index of the fiber in the bundle: the
+// parameterisation only moves it to the centre of that fiber, in the frame
+// of the envelope containing the bundle, the cores being its daughters.
+
+#ifndef FiberParameterisation_h
+#define FiberParameterisation_h 1
+
+#include <vector>
+
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+#include "G4VPVParameterisation.hh"
+
+class G4VPhysicalVolume ;
+
+
+
+class FiberParameterisation : public G4VPVParameterisation
+{
+public:
+  FiberParameterisation  (const std::vector<G4ThreeVector>& positions) ;
+  ~FiberParameterisation () ;
+  
+  G4int GetNFibers () const { return fPositions.size () ; } ;
+  
+  void ComputeTransformation (const G4int copyNo, G4VPhysicalVolume* physVol) const ;
+  
+private:
+  std::vector<G4ThreeVector> fPositions ;   // in the frame of the mother volume
+} ;
+
+#endif
@@ -0,0 +1,56 @@
+// Analytic transport of the optical photons along the fiber cores.
+// A fast simulation model of the FiberCores region: when an optical photon
+// enters a core (or is created in it) the model decides from its angle to the
+// fiber axis and the refractive indices of core and cladding whether it is
+// trapped by total internal reflection. The trapped photons are not tracked:
+// their path to the end of the fiber, along the direction they travel, is
+// computed at once, cut by the absorption sampled from the core absorption
+// length, and given to the fiber in the CreateTree, as the FiberCoreSD would;
+// the arrival time is set as the final time of the photon, which is then killed.
+// The photons not trapped are left to the full tracking.
+// In validation mode the photons are always tracked, and the prediction of the
+// model for each photon entering a core is written to the fastPhLengthInChamfer
+// and numFastPhotonsInChamfer branches, to be compared with the tracked ones.
+
+#ifndef FiberTransportModel_h
+#define FiberTransportModel_h 1
+
+#include "globals.hh"
+#include "G4VFastSimulationModel.hh"
+
+class FiberVolumeTable ;
+class G4Material ;
+
+
+
+class FiberTransportModel : public G4VFastSimulationModel
+{
+public:
+  FiberTransportModel  (const G4String& name, G4Region* envelope, const FiberVolumeTable* fiberTable, G4bool validation) ;
+  ~FiberTransportModel () ;
+  
+  virtual G4bool IsApplicable (const G4ParticleDefinition& particle) ;
+  virtual G4bool ModelTrigger (const G4FastTrack& fastTrack) ;
+  virtual void   DoIt         (const G4FastTrack& fastTrack, G4FastStep& fastStep) ;
+  
+private:
+  // the transport of a trapped photon to the end of its fiber
+  struct Transport
+  {
+    G4int    fiber ;
+    G4double length ;
+    G4double time ;
+  } ;
+  
+  // false if the photon is not trapped in the core
+  G4bool ComputeTransport (const G4FastTrack& fastTrack, Transport& transport) const ;
+  static G4double GetProperty (const G4Material* material, const char* key, G4double energy) ;
+  
+  const FiberVolumeTable* fFiberTable ;
+  G4bool    fValidation ;
+  Transport fTransport ;        // computed by the trigger, used by DoIt
+  G4int     fLastEvent ;        // last photon predicted in validation mode
+  G4int     fLastTrack ;
+} ;
+
+#endif
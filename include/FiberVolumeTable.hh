@@ -0,0 +1,122 @@
+// Table of the fiber volumes of the geometry, filled by DetectorConstruction::Construct ().
+// The fibers of a chamfer are the copies of one parameterised cladding volume,
+// each containing the outer and then the inner core; a fiber index is the index
+// of the bundle's first fiber plus the copy number of the cladding, so that the
+// stepping can tell from the touchable of a step point in which fiber and part
+// of it the point is, with a few pointer comparisons.
+
+#ifndef FiberVolumeTable_h
+#define FiberVolumeTable_h 1
+
+#include <vector>
+
+#include "globals.hh"
+#include "G4TwoVector.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4VTouchable.hh"
+
+
+
+class FiberVolumeTable
+{
+public:
+  enum Part { kNone = -1, kCoreIns = 0, kCoreOut = 1, kClad = 2 } ;
+  
+  FiberVolumeTable  () {} ;
+  ~FiberVolumeTable () {} ;
+  
+  void  Clear () { fFibers.clear () ; fChamfers.clear () ; fVolumes.clear () ; fCellStart.clear () ; fCellFibers.clear () ; } ;
+  // add a fiber in a chamfer at a transverse position, returns its index;
+  // the fibers of a chamfer are added one after the other
+  G4int AddFiber (G4int chamfer, const G4TwoVector& position) ;
+  // a volume that is a part of nFibers fibers from firstFiber on, the index among them
+  // is the replica number of the touchable at the given depth
+  void  AddVolume (const G4VPhysicalVolume* volume, Part part, G4int depth, G4int firstFiber, G4int nFibers) ;
+  
+  G4int GetNFibers () const { return fFibers.size () ; } ;
+  G4int GetChamfer (G4int fiber) const { return fFibers[fiber].chamfer ; } ;
+  // index of the fiber among the ones of its chamfer
+  G4int GetIndexInChamfer (G4int fiber) const { return fFibers[fiber].indexInChamfer ; } ;
+  const G4TwoVector& GetPosition (G4int fiber) const { return fFibers[fiber].position ; } ;
+  // the volume of a part of a fiber, shared with the other fibers of its bundle
+  const G4VPhysicalVolume* GetVolume (G4int fiber, Part part) const ;
+  
+  // sort the fibers of each chamfer in a grid, for FindNearestFiber: to be called
+  // once all the fibers are added, the searches go through all the fibers until then
+  void  BuildSearchGrid () ;
+  // fiber whose axis is the closest to a transverse position, -1 if there are no fibers
+  G4int FindNearestFiber (const G4TwoVector& point, G4double& distance) const ;
+  // true if a transverse unit direction from a point makes a cosine of at least minCos
+  // with the direction to some fiber axis of any chamfer, bounded by the box of the chamfer
+  G4bool IsHeadingToFibers (const G4TwoVector& point, const G4TwoVector& direction, G4double minCos) const ;
+  
+  // part of a fiber the touchable is in, kNone if it is not a fiber volume
+  inline Part  GetPart (const G4VTouchable* touchable, G4int& fiber) const ;
+  inline G4bool IsCore (const G4VTouchable* touchable, G4int& fiber) const ;
+  
+private:
+  struct Fiber
+  {
+    G4int chamfer ;
+    G4int indexInChamfer ;
+    G4TwoVector position ;
+  } ;
+  
+  struct Volume
+  {
+    const G4VPhysicalVolume* volume ;
+    Part  part ;
+    G4int depth ;               // of the parameterised volume, whose copy number is the fiber in the bundle
+    G4int firstFiber ;
+    G4int nFibers ;
+  } ;
+  
+  // range of the fibers of a chamfer and their bounding box, to skip far chamfers in the searches,
+  // and the search grid over the box: square cells of side cell, nx x ny from firstCell on
+  struct Chamfer
+  {
+    G4int first ;
+    G4int last ;
+    G4TwoVector min ;
+    G4TwoVector max ;
+    G4double cell ;
+    G4int nx ;
+    G4int ny ;
+    G4int firstCell ;
+  } ;
+  
+  G4int CellX (const Chamfer& range, G4double x) const ;
+  G4int CellY (const Chamfer& range, G4double y) const ;
+  void  SearchGrid (const Chamfer& range, const G4TwoVector& point, G4int& nearest, G4double& nearest2) const ;
+  
+  std::vector<Fiber>   fFibers ;
+  std::vector<Chamfer> fChamfers ;
+  std::vector<Volume>  fVolumes ;       // a few per chamfer, the cores first
+  std::vector<G4int>   fCellStart ;     // first entry in fCellFibers of each cell of all the grids, and the end
+  std::vector<G4int>   fCellFibers ;    // fibers of each cell, in increasing index
+} ;
+
+
+
+inline FiberVolumeTable::Part FiberVolumeTable::GetPart (const G4VTouchable* touchable, G4int& fiber) const
+{
+  if (!touchable) return kNone ;
+  const G4VPhysicalVolume* volume = touchable->GetVolume () ;
+  for (unsigned int iVolume = 0 ; iVolume < fVolumes.size () ; ++iVolume)
+    {
+      const Volume& entry = fVolumes[iVolume] ;
+      if (entry.volume != volume) continue ;
+      fiber = entry.firstFiber + touchable->GetReplicaNumber (entry.depth) ;
+      return entry.part ;
+    }
+  return kNone ;
+}
+
+
+inline G4bool FiberVolumeTable::IsCore (const G4VTouchable* touchable, G4int& fiber) const
+{
+  Part part = GetPart (touchable, fiber) ;
+  return part == kCoreIns || part == kCoreOut ;
+}
+
+#endif
@@ -47,9 +47,10 @@
 
 #include "G4VPhysicsConstructor.hh"
 #include "globals.hh"
+#include "OpticalPhotonLimiter.hh"
 
 class G4Cerenkov;
-class G4Scintillation;
+class LayerScintillation;
 class G4OpAbsorption;
 class G4OpRayleigh;
 class G4OpMieHG;
@@ -62,6 +63,8 @@ class G4EmUserPhysics : public G4VPhysicsConstructor
 public:
 
   G4EmUserPhysics(G4int ver = 1);
+  // also limit the optical photons in time, length and steps
+  G4EmUserPhysics(G4int ver, const ConfigFile& config);
 
   virtual ~G4EmUserPhysics();
 
@@ -72,12 +75,20 @@ private:
   G4int verbose;
 
   G4Cerenkov * theCerenkovProcess;
-  G4Scintillation * theScintillationProcess;
+  LayerScintillation * theScintillationProcess;
   G4OpAbsorption * theAbsorptionProcess;
   G4OpRayleigh * theRayleighScatteringProcess;
   G4OpMieHG * theMieHGScatteringProcess;
   G4OpBoundaryProcess * theBoundaryProcess;
 
+  G4double scintFraction;      // fraction of the scintillation photons generated
+  G4int firstOpticalLayer;     // layers and fibers where the scintillation light is generated
+  G4int lastOpticalLayer;
+  G4bool opticalFibers;
+  G4bool useFastSimulation;
+  G4bool useLimiter;
+  OpticalPhotonLimiter::Limits limiterLimits[OpticalPhotonLimiter::kNRegions];
+
 };
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,36 @@
+// Scintillation restricted to a range of layers.
+// The optical photons are generated only in the crystals of the layers
+// optical_firstLayer ... optical_lastLayer and, if optical_fibers is set,
+// in the fibers; elsewhere the steps just deposit their energy.
+// The energy deposited in the crystals by the charged particles is recorded
+// layer by layer in the depositInLayer branch of the CreateTree, in all the
+// layers, so that the longitudinal profile is known also where no light is made.
+
+#ifndef LayerScintillation_h
+#define LayerScintillation_h 1
+
+#include "globals.hh"
+#include "G4Scintillation.hh"
+
+class DetectorConstruction ;
+
+
+
+class LayerScintillation : public G4Scintillation
+{
+public:
+  // a negative lastLayer means up to the last layer
+  LayerScintillation  (const G4String& name, G4int firstLayer, G4int lastLayer, G4bool fibers) ;
+  ~LayerScintillation () ;
+  
+  virtual G4VParticleChange* PostStepDoIt (const G4Track& track, const G4Step& step) ;
+  virtual G4VParticleChange* AtRestDoIt   (const G4Track& track, const G4Step& step) ;
+  
+private:
+  const DetectorConstruction* fDetector ;
+  G4int  fFirstLayer ;
+  G4int  fLastLayer ;
+  G4bool fFibers ;
+} ;
+
+#endif
@@ -0,0 +1,77 @@
+// Lookup table of the light collection from the crystals to the fibers.
+// The table gives, for a binned emission position within the tile (x and y
+// across the module, z within the layer), the probability that a scintillation
+// photon emitted there is first seen in the fibers of each chamfer.
+// In calibration mode the photons emitted in the crystals and the ones reaching
+// the fibers are counted, and at the end of each run the counts are written to a
+// new file of the table directory, <cacheDir>/<hash of the key>/, so that any
+// number of jobs, forks or threads can fill the same table.
+// In fast mode all the count files of the directory are summed into the
+// probabilities, used to sample the photons of the chamfers at each step in
+// the crystals, without generating optical photons there.
+// The key is made of the geometry, material and optics parameters of the
+// detector and of the binning, and is stored next to the counts.
+
+#ifndef LightCollectionTable_h
+#define LightCollectionTable_h 1
+
+#include <string>
+#include <vector>
+
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+
+// G4ThreadLocal is only provided by multi-threaded capable Geant4 versions
+#ifndef G4ThreadLocal
+#define G4ThreadLocal
+#endif
+
+
+
+class LightCollectionTable
+{
+public:
+  enum Mode { kOff = 0, kCalibration = 1, kFast = 2 } ;
+  enum { kNChamfers = 4 } ;
+  
+  // the tile is size.x () x size.y () centred on the axis, layers of size.z () start at zFront;
+  // the table becomes the instance of the calling thread
+  LightCollectionTable  (Mode mode, const std::string& cacheDir, const std::string& key,
+                         const std::vector<int>& bins, const G4ThreeVector& size, G4double zFront) ;
+  ~LightCollectionTable () ;
+  
+  static LightCollectionTable* Instance () { return fInstance ; } ;
+  Mode GetMode () const { return fMode ; } ;
+  
+  // calibration: count a photon emitted in a crystal, and one reaching a chamfer
+  void   Emit    (const G4ThreeVector& emission) ;
+  void   Collect (const G4ThreeVector& emission, G4int chamfer) ;
+  // write the counts collected so far to a new file and reset them
+  G4bool Save () ;
+  
+  // fast: sum the counts stored for the key, returns false if there are none
+  G4bool Load () ;
+  G4bool IsLoaded () const { return !fProbability.empty () ; } ;
+  // probabilities of the chamfers for a photon emitted at a position, 0 if outside the table
+  const G4double* GetProbabilities (const G4ThreeVector& emission) const ;
+  
+private:
+  G4int Bin (const G4ThreeVector& position) const ;
+  
+  Mode        fMode ;
+  std::string fTableDir ;
+  std::string fKey ;
+  G4int       fBins[3] ;
+  G4ThreeVector fSize ;
+  G4double    fZFront ;
+  
+  std::vector<G4double> fEmitted ;        // per bin
+  std::vector<G4double> fCollected ;      // per bin and chamfer
+  std::vector<G4double> fProbability ;    // per bin and chamfer, filled by Load ()
+  G4double              fNone[kNChamfers] ;
+  
+  static G4ThreadLocal LightCollectionTable* fInstance ;
+  static G4ThreadLocal G4int fNSaved ;   // count files written by the thread, in their names
+} ;
+
+#endif
@@ -0,0 +1,59 @@
+// Limits on the global time, track length and number of steps of the optical photons.
+// The limits depend on the region the photon is traveling in: the crystals,
+// the fibers (cores and cladding) or the rest of the detector, and are read
+// from the configuration:
+//   optical_maxTime_<region>   = 50     in [ns]
+//   optical_maxLength_<region> = 1000   in [mm]
+//   optical_maxSteps_<region>  = 10000
+// with <region> one of crystal, fiber, other; a non positive value turns the limit off.
+// The process is forced at every step of the optical photons and kills the ones
+// beyond the limits of the region of the step, counting them per reason
+// in the CreateTree of the event.
+
+#ifndef OpticalPhotonLimiter_h
+#define OpticalPhotonLimiter_h 1
+
+#include "globals.hh"
+#include "G4VDiscreteProcess.hh"
+#include "ConfigFile.hh"
+
+class DetectorConstruction ;
+
+
+
+class OpticalPhotonLimiter : public G4VDiscreteProcess
+{
+public:
+  enum Region { kCrystal = 0, kFiber = 1, kOther = 2, kNRegions = 3 } ;
+  enum Reason { kTime = 0, kLength = 1, kSteps = 2 } ;
+  
+  struct Limits
+  {
+    G4double maxTime ;      // 0 for no limit
+    G4double maxLength ;
+    G4int    maxSteps ;
+  } ;
+  
+  // read the limits of all the regions, returns false if none is set
+  static G4bool ReadLimits (const ConfigFile& config, Limits limits[kNRegions]) ;
+  
+  OpticalPhotonLimiter  (const Limits limits[kNRegions], const G4String& name = "OpticalPhotonLimiter") ;
+  ~OpticalPhotonLimiter () ;
+  
+  virtual G4bool IsApplicable (const G4ParticleDefinition& particle) ;
+  
+  virtual G4double PostStepGetPhysicalInteractionLength (const G4Track& track, G4double previousStepSize,
+                                                         G4ForceCondition* condition) ;
+  virtual G4VParticleChange* PostStepDoIt (const G4Track& track, const G4Step& step) ;
+  
+protected:
+  virtual G4double GetMeanFreePath (const G4Track&, G4double, G4ForceCondition*) { return DBL_MAX ; } ;
+  
+private:
+  Region GetRegion (const G4StepPoint* point) const ;
+  
+  const DetectorConstruction* fDetector ;
+  Limits fLimits[kNRegions] ;
+} ;
+
+#endif
@@ -0,0 +1,60 @@
+// Merges the output files written by the workers of a job
+// (threads, forked processes or independent batch jobs) into a single file.
+// The inputs are concatenated: groups of inputs are merged in parallel
+// by forked processes, then the partial results are concatenated in order;
+// when all the files share the same compression settings the baskets
+// are copied without being decompressed and recompressed.
+// If the event ranges of the inputs are not disjoint and increasing,
+// as for the threads that share the events dynamically, the merged tree
+// gets an index on Event (TTree::BuildIndex) to be read in event order.
+// With SetRenumber the events of each input are shifted after the ones
+// of the previous inputs, for jobs that all started from event 0: only then
+// the entries are copied one by one, inputs already in order are kept as they are.
+// The inputs are removed, if asked, only once the output holds all their entries.
+
+#ifndef OutputMerger_h
+#define OutputMerger_h 1
+
+#include <vector>
+
+#include "TString.h"
+
+
+
+class OutputMerger
+{
+public:
+  OutputMerger  (const TString& treeName = "tree") ;
+  ~OutputMerger () ;
+  
+  void AddInput          (const TString& fileName) { fInputs.push_back (fileName) ; } ;
+  void SetNProcesses     (int nProcesses)          { fNProcesses = nProcesses ; } ;
+  void SetRenumber       (bool renumber)           { fRenumber = renumber ; } ;
+  void SetRemoveInputs   (bool removeInputs)       { fRemoveInputs = removeInputs ; } ;
+  
+  bool Merge (const TString& outputName) ;
+  
+private:
+  bool CheckInputs  () ;
+  bool Concatenate  (const std::vector<TString>& inputs, const TString& outputName) const ;
+  bool ParallelConcatenate (const TString& outputName) const ;
+  bool SortedCopy   (const TString& outputName) const ;
+  bool BuildIndex   (const TString& outputName) const ;
+  bool CheckOutput  (const TString& outputName) const ;
+  
+  TString              fTreeName ;
+  std::vector<TString> fInputs ;
+  int                  fNProcesses ;
+  bool                 fRenumber ;
+  bool                 fRemoveInputs ;
+  
+  // filled by CheckInputs
+  std::vector<Long64_t> fEntries ;
+  std::vector<int>      fFirstEvent ;
+  std::vector<int>      fLastEvent ;
+  int                   fCompression ;
+  bool                  fSameCompression ;
+  bool                  fOrdered ;
+} ;
+
+#endif
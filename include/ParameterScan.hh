@@ -0,0 +1,49 @@
+// In-process scan of the detector parameters.
+// The scan file lists one point per line, as key=value settings
+// applied on top of the base configuration, e.g.
+//   abs_d=3 crystal_d=1.5
+//   abs_d=4 crystal_d=1.5 nLayers_z=20
+// lines starting with # are comments.
+// Only the keys of the detector that can change after its construction
+// (see DetectorConstruction::IsUpdatable) can be scanned, a file with other keys is refused.
+// For each point only what the new settings change is built again,
+// then the macro file is executed. All the points are written to the same
+// output tree, the ScanPoint branch tells them apart, and the settings
+// of each point are saved in the output file as a TNamed "scanPoint_<index>".
+
+#ifndef ParameterScan_h
+#define ParameterScan_h 1
+
+#include <string>
+#include <vector>
+
+#include "globals.hh"
+#include "ConfigFile.hh"
+
+class ShashlikRunManager ;
+class CreateTree ;
+
+
+
+class ParameterScan
+{
+public:
+  ParameterScan  (ShashlikRunManager* runManager, CreateTree* tree, const ConfigFile& baseConfig) ;
+  ~ParameterScan () ;
+  
+  // read the scan points, returns false if the file cannot be read
+  G4bool ReadPoints (const std::string& scanFileName) ;
+  
+  // run the macro at each scan point, the output file has to be already open
+  G4bool Run (const std::string& macroFileName) ;
+  
+  G4int GetNPoints () const { return fPoints.size () ; } ;
+  
+private:
+  ShashlikRunManager*      fRunManager ;
+  CreateTree*              fTree ;
+  ConfigFile               fBaseConfig ;
+  std::vector<std::string> fPoints ;
+} ;
+
+#endif
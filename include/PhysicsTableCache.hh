@@ -0,0 +1,47 @@
+// On-disk cache of the physics tables.
+// The tables built by Geant4 are stored in a subdirectory of the cache
+// directory named after a key made of the physics list name, the materials
+// and the production cuts, and retrieved by the following jobs with the same key.
+// A job whose key is not in the cache builds the tables and adds them to it.
+// The full key is stored next to the tables and checked before retrieving them,
+// so that a hash collision cannot load the wrong tables.
+
+#ifndef PhysicsTableCache_h
+#define PhysicsTableCache_h 1
+
+#include <string>
+
+#include "globals.hh"
+
+class G4VUserPhysicsList ;
+
+
+
+class PhysicsTableCache
+{
+public:
+  // an empty cacheDir disables the cache
+  PhysicsTableCache  (const std::string& cacheDir, const std::string& physicsListName, G4VUserPhysicsList* physics) ;
+  ~PhysicsTableCache () ;
+  
+  G4bool IsEnabled () const { return fCacheDir != "" ; } ;
+  
+  // to be called after the kernel initialization, when the geometry, the materials and
+  // the cuts of the physics list are set, and before the first run:
+  // returns true if the tables will be retrieved from the cache
+  G4bool Retrieve () ;
+  // to be called once the tables are built: adds them to the cache, if they were not retrieved
+  G4bool Store () ;
+  
+private:
+  std::string MakeKey () const ;
+  std::string TablesDir () const ;
+  
+  std::string         fCacheDir ;
+  std::string         fPhysicsListName ;
+  G4VUserPhysicsList* fPhysics ;
+  std::string         fKey ;
+  G4bool              fRetrieved ;
+} ;
+
+#endif
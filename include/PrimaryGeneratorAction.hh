@@ -52,6 +52,8 @@ public:
 public:
   void GeneratePrimaries(G4Event*);
   
+  void SetPosCentre(const G4ThreeVector& posCentre);
+  
 private:
   G4GeneralParticleSource* gun;
 };
@@ -0,0 +1,75 @@
+// Run manager of the simulation.
+// On top of the standard G4RunManager it can fork worker processes
+// after the initialization, so that the geometry and the physics tables
+// are built once and shared copy-on-write by all the workers.
+// Each worker then processes its own slice of the events requested
+// by /run/beamOn, and the events keep their global numbering.
+// A resumed job skips the events it had already simulated.
+
+#ifndef ShashlikRunManager_h
+#define ShashlikRunManager_h 1
+
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+#include "globals.hh"
+#include "G4RunManager.hh"
+
+class ConfigFile ;
+
+
+
+class ShashlikRunManager : public G4RunManager
+{
+public:
+  ShashlikRunManager  () ;
+  virtual ~ShashlikRunManager () ;
+  
+  virtual void BeamOn (G4int n_event, const char* macroFile = 0, G4int n_select = -1) ;
+  
+  // fork nWorkers processes: returns the worker index in the children, -1 in the parent
+  G4int  ForkWorkers    (G4int nWorkers) ;
+  // wait for the termination of the workers, returns false if any of them failed
+  G4bool WaitForWorkers () ;
+  
+  // build the geometry again from the user detector construction, keeping the physics
+  void RebuildGeometry () ;
+  // the configuration the job started with, the reference of Reconfigure
+  void SetConfig (const ConfigFile& config) ;
+  // apply a new configuration to the DetectorConstruction, rebuilding only what it changes,
+  // returns the DetectorConstruction changes flags; kRejected, with nothing changed,
+  // if it changes keys that are read only at construction, other than the callerKeys
+  // that the caller applies itself
+  enum { kRejected = -1 } ;
+  G4int Reconfigure (const ConfigFile& config, const std::vector<std::string>& callerKeys = std::vector<std::string> ()) ;
+  // the next run starts again from event 0
+  void ResetEventNumbering () { fEventsBefore = 0 ; } ;
+  // the first nEvents events of this process are already done, resuming a job:
+  // the following runs skip them, keeping the event numbering
+  void SkipEvents (G4int nEvents) { fEventsToSkip = nEvents ; } ;
+  
+  G4int GetWorkerIndex () const { return fWorkerIndex ; } ;
+  G4int GetNWorkers    () const { return fNWorkers ; } ;
+  
+  // global number of the first event of the current run in this process
+  static G4int GetEventOffset () { return fFirstEvent + fEventOffset ; } ;
+  // number of the first event of the job, for jobs that simulate a part of a larger sample
+  static void  SetFirstEvent (G4int firstEvent) { fFirstEvent = firstEvent ; } ;
+  // the G4MTRunManager does not go through BeamOn: its master moves the offset
+  // past the events of each run once they are done
+  static void  AdvanceEventOffset (G4int nEvents) { if (nEvents > 0) fEventOffset += nEvents ; } ;
+  
+private:
+  G4int fWorkerIndex ;
+  G4int fNWorkers ;
+  G4int fEventsBefore ;               // events requested by the previous runs
+  G4int fEventsToSkip ;
+  std::vector<pid_t> fWorkerPIDs ;
+  ConfigFile*        fConfig ;       // the configuration currently applied
+  
+  static G4int fEventOffset ;
+  static G4int fFirstEvent ;
+} ;
+
+#endif
@@ -0,0 +1,48 @@
+// Resident simulation server.
+// The process is initialized once and then serves run requests read from a FIFO,
+// one per line:
+//   <macro file> <output file> [<configuration file>]
+// the output is written to <output file>.root, as in exec mode.
+// When a request comes with a configuration file, only what the new
+// configuration invalidates is built again (see ShashlikRunManager::Reconfigure).
+// The request "quit" stops the server.
+// Each request gets a master seed of its own: the seed of its configuration file,
+// or one derived from the seed of the server and the request count, so that two
+// requests never simulate the same events; it is written to the output file.
+// If a reader has opened <FIFO>.reply, a line "done <output file>" or
+// "failed <output file>" is written there at the end of each request.
+
+#ifndef SimulationServer_h
+#define SimulationServer_h 1
+
+#include <string>
+
+#include "globals.hh"
+
+class ShashlikRunManager ;
+class CreateTree ;
+
+
+
+class SimulationServer
+{
+public:
+  SimulationServer  (ShashlikRunManager* runManager, CreateTree* tree, const std::string& fifoName) ;
+  ~SimulationServer () ;
+  
+  // serve the requests until "quit", returns the number of failed requests
+  G4int Serve () ;
+  
+private:
+  G4bool Process (const std::string& request) ;
+  G4bool Configure (const std::string& configFileName, G4long& seed) ;
+  void   Reply (const std::string& message) const ;
+  
+  ShashlikRunManager*   fRunManager ;
+  CreateTree*           fTree ;
+  std::string           fFifoName ;
+  G4long                fBaseSeed ;          // master seed the server started with
+  G4int                 fNRequests ;
+} ;
+
+#endif
@@ -0,0 +1,79 @@
+// Stacking policy of the optical photons.
+// A new optical photon can be killed, deferred to the waiting stack or
+// tracked at once, according to the volume where it is created, its
+// transverse distance from the nearest fiber and its transverse direction
+// with respect to the fibers of the chamfers. The rules are read from the configuration:
+//   stack_killVolumes     = |Absorber|World|   photons created in these volumes are killed
+//   stack_maxDistance     = 2                  photons created farther (mm) from the nearest fiber are killed
+//   stack_minCosToFiber   = 0                  photons heading away from the fibers of every chamfer,
+//                                              by more than this cosine, are killed
+//   stack_deferDistance   = 1                  photons created farther (mm) are tracked after the others
+// a negative distance or a cosine below -1 turn the rule off.
+// With the scintillation thinning, scint_fraction = f < 1, the scintillation
+// process generates a fraction f of the photons, which get the weight 1/f here.
+// The photons removed by each rule are counted over the run.
+// With optical_tileThreshold = E (MeV) the photons of the crystals are held until
+// the rest of the event is done, and the ones of the layers with a deposit
+// below E are killed (see LayerScintillation for the deposits).
+// The photons created in the crystals are also counted by the light collection
+// table in calibration mode, and killed in fast mode, where the table accounts for them.
+
+#ifndef StackingAction_H
+#define StackingAction_H 1
+
+#include <vector>
+#include <string>
+
+#include "globals.hh"
+#include "G4UserStackingAction.hh"
+#include "ConfigFile.hh"
+
+class FiberVolumeTable ;
+class DetectorConstruction ;
+class G4VProcess ;
+
+
+
+class StackingAction : public G4UserStackingAction
+{
+public:
+  StackingAction  (const ConfigFile& config) ;
+  ~StackingAction () ;
+  
+  virtual G4ClassificationOfNewTrack ClassifyNewTrack (const G4Track* track) ;
+  virtual void NewStage () ;
+  virtual void PrepareNewEvent () ;
+  
+  void ResetCounters () ;
+  void PrintCounters () const ;
+  
+private:
+  G4ClassificationOfNewTrack ApplyRules     (const G4Track* track) ;
+  G4ClassificationOfNewTrack ClassifyByTile (const G4Track* track) ;
+  void CountEmission (const G4Track* track) ;
+  G4bool IsScintillation (const G4VProcess* process) ;
+  
+  const DetectorConstruction* fDetector ;
+  const FiberVolumeTable*  fFiberTable ;
+  
+  std::vector<std::string> fKillVolumes ;
+  G4double                 fMaxDistance ;
+  G4double                 fMinCosToFiber ;
+  G4double                 fDeferDistance ;
+  G4bool                   fNeedsFiber ;      // any of the rules uses the nearest fiber
+  G4double                 fScintFraction ;
+  const G4VProcess*        fScintillation ;   // found at the first scintillation photon
+  G4double                 fTileThreshold ;
+  G4int                    fStage ;           // stage of the event stacking
+  
+  // run counters
+  G4long fNPhotons ;
+  G4long fKilledByVolume ;
+  G4long fKilledByDistance ;
+  G4long fKilledByDirection ;
+  G4long fDeferred ;
+  G4long fReplacedByTable ;
+  G4long fKilledByThreshold ;
+} ;
+
+#endif
@@ -0,0 +1,50 @@
+// Wall time, CPU time and resident memory growth of the startup phases.
+// Phases are opened and closed by name and can be nested,
+// e.g. the geometry construction within the run manager initialization.
+// The profile is printed to stdout and saved as the "startupProfile" tree
+// in the output file.
+
+#ifndef StartupProfiler_h
+#define StartupProfiler_h 1
+
+#include <iostream>
+#include <vector>
+
+#include "globals.hh"
+
+class TTree ;
+
+
+
+class StartupProfiler
+{
+public:
+  static void BeginPhase (const G4String& name) ;
+  // close the innermost phase if it is the one called name, otherwise do nothing
+  static void EndPhase   (const G4String& name) ;
+  
+  static void   Print    (std::ostream& out) ;
+  // a new tree with one entry per phase, not attached to any directory
+  static TTree* MakeTree () ;
+  
+private:
+  struct Phase
+  {
+    G4String name ;
+    G4int    depth ;
+    G4bool   open ;
+    G4double wallTime ;     // s
+    G4double cpuTime ;      // s
+    G4double rss ;          // MB, at the end of the phase
+    G4double rssGrowth ;    // MB
+  } ;
+  
+  static G4double WallTime () ;
+  static G4double CpuTime () ;
+  static G4double Rss () ;
+  
+  static std::vector<Phase> fPhases ;
+  static std::vector<int>   fOpenPhases ;    // indices of the phases not closed yet
+} ;
+
+#endif
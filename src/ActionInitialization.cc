@@ -0,0 +1,87 @@
+#include "ActionInitialization.hh"
+
+#include "PrimaryGeneratorAction.hh"
+#include "RunAction.hh"
+#include "EventAction.hh"
+#include "TrackingAction.hh"
+#include "StackingAction.hh"
+#include "SteppingVerbose.hh"
+#include "CreateTree.hh"
+
+#ifdef G4MULTITHREADED
+#include "G4Threading.hh"
+#endif
+
+
+
+ActionInitialization::ActionInitialization (const ConfigFile& config, const G4ThreeVector& posCentre, const G4String& outputName) :
+  fConfig (config),
+  fPosCentre (posCentre),
+  fOutputName (outputName)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+ActionInitialization::~ActionInitialization ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void ActionInitialization::Build () const
+{
+#ifdef G4MULTITHREADED
+  // each worker thread fills its own tree, merged by the master at the end of the job
+  TString fileName = "" ;
+  if (fOutputName != "") fileName = Form ("%s_t%d.root", fOutputName.c_str (), G4Threading::G4GetThreadId ()) ;
+  CreateTree::CreateWorker ("tree", fileName) ;
+#endif
+
+  G4cout << ">>> Define PrimaryGeneratorAction::begin <<<" << G4endl ;
+  SetUserAction (new PrimaryGeneratorAction (fPosCentre)) ;
+  G4cout << ">>> Define PrimaryGeneratorAction::end <<<" << G4endl ;
+
+  G4cout << ">>> Define RunAction::begin <<<" << G4endl ;
+  SetUserAction (new RunAction) ;
+  G4cout << ">>> Define RunAction::end <<<" << G4endl ;
+
+  G4cout << ">>> Define EventAction::begin <<<" << G4endl ;
+  SetUserAction (new EventAction) ;
+  G4cout << ">>> Define EventAction::end <<<" << G4endl ;
+
+  G4cout << ">>> Define TrackingAction::begin <<<" << G4endl ;
+  SetUserAction (new TrackingAction) ;
+  G4cout << ">>> Define TrackingAction::end <<<" << G4endl ;
+
+  G4cout << ">>> Define StackingAction::begin <<<" << G4endl ;
+  SetUserAction (new StackingAction (fConfig)) ;
+  G4cout << ">>> Define StackingAction::end <<<" << G4endl ;
+  
+  // the photons in the fibers are accounted for by the FiberCoreSD,
+  // no user code runs for the steps outside of the fiber cores
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+#ifdef G4MULTITHREADED
+
+void ActionInitialization::BuildForMaster () const
+{
+  SetUserAction (new RunAction) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4VSteppingVerbose* ActionInitialization::InitializeSteppingVerbose () const
+{
+  return new SteppingVerbose ;
+}
+
+#endif
@@ -1,30 +1,68 @@
 #include "CreateTree.hh"
+#include "EventSeeder.hh"
 #include <cassert>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include "TROOT.h"
+#include "TNamed.h"
+
+#ifdef G4MULTITHREADED
+#include "G4AutoLock.hh"
+namespace { G4Mutex workersMutex = G4MUTEX_INITIALIZER ; }
+#endif
 
 
 using namespace std ;
 
-CreateTree* CreateTree::fInstance = NULL ;
+G4ThreadLocal CreateTree* CreateTree::fInstance = NULL ;
+std::vector<CreateTree*> CreateTree::fWorkers ;
 
 
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
 
-CreateTree::CreateTree (TString name)
+CreateTree::CreateTree (TString name, bool registerInstance)
 {
-  if ( fInstance )
+  if ( registerInstance )
   {
-    return ;
+    if ( fInstance )
+    {
+      return ;
+    }
+    this->fInstance = this ;
   }
 
-  this->fInstance = this ;
+  this->ffile     = NULL ;
+  this->fcheckpointInterval    = 0 ;
+  this->feventsSinceCheckpoint = 0 ;
   this->fname     = name ;
   this->ftree     = new TTree (name,name) ;
   
+  this->fiberIndex    = new std::vector<int> () ;
+  this->fiberPhotons  = new std::vector<int> () ;
+  this->fiberPhLength = new std::vector<float> () ;
+  this->depositInLayer = new std::vector<float> () ;
+  
   this->GetTree ()->Branch ("Event",                  &this->Event,                  "Event/I") ;
+  this->GetTree ()->Branch ("Seed",                   &this->Seed,                   "Seed/L") ;
+  this->GetTree ()->Branch ("Seed2",                  &this->Seed2,                  "Seed2/L") ;
+  this->GetTree ()->Branch ("ScanPoint",              &this->ScanPoint,              "ScanPoint/I") ;
+  this->GetTree ()->Branch ("ScintFraction",          &this->ScintFraction,          "ScintFraction/F") ;
   this->GetTree ()->Branch ("totalPhLengthInChamfer", &this->totalPhLengthInChamfer, "totalPhLengthInChamfer[4]/F") ;
   this->GetTree ()->Branch ("numPhotonsInChamfer",    &this->numPhotonsInChamfer,    "numPhotonsInChamfer[4]/I") ;
+  this->GetTree ()->Branch ("weightedPhotonsInChamfer", &this->weightedPhotonsInChamfer, "weightedPhotonsInChamfer[4]/F") ;
+  this->GetTree ()->Branch ("fastPhLengthInChamfer",  &this->fastPhLengthInChamfer,  "fastPhLengthInChamfer[4]/F") ;
+  this->GetTree ()->Branch ("numFastPhotonsInChamfer", &this->numFastPhotonsInChamfer, "numFastPhotonsInChamfer[4]/I") ;
+  this->GetTree ()->Branch ("numPhotonsKilled",       &this->numPhotonsKilled,       "numPhotonsKilled[3]/I") ;
+  this->GetTree ()->Branch ("fiberIndex",             &this->fiberIndex) ;
+  this->GetTree ()->Branch ("fiberPhotons",           &this->fiberPhotons) ;
+  this->GetTree ()->Branch ("fiberPhLength",          &this->fiberPhLength) ;
+  this->GetTree ()->Branch ("depositInLayer",         &this->depositInLayer) ;
   
+  this->ScanPoint = 0 ;
+  this->ScintFraction = 1. ;
   this->Clear () ;
 }
 
@@ -40,23 +78,25 @@ CreateTree::~CreateTree ()
 
 
 /**
-Loop on the container of the single photon total track in fibers cores.
-Check the correctness of the chamfer ID assignment.
-Count the number of photons for each chamfer.
-The total length of photons in each chamfer is already saved in totalPhLengthInChamfer,
-for historical reasons.
+The photons are already counted for each chamfer and each fiber by addPhoton.
+Only the fibers hit are written, in increasing index order.
 */
 int CreateTree::Fill () 
 { 
-  for (std::map <int, std::pair<int, float> >::const_iterator iMap = fsingleGammaInfo.begin () ;
-       iMap != fsingleGammaInfo.end () ;
-       ++iMap)
+  std::sort (ffibersHit.begin (), ffibersHit.end ()) ;
+  for (unsigned int iHit = 0 ; iHit < ffibersHit.size () ; ++iHit)
     {
-      assert (iMap->second.first < 4) ;
-      assert (iMap->second.first >= 0) ;
-      ++numPhotonsInChamfer[iMap->second.first] ;
+      int fiber = ffibersHit[iHit] ;
+      fiberIndex->push_back (fiber) ;
+      fiberPhotons->push_back (ffiberPhotons[fiber]) ;
+      fiberPhLength->push_back (ffiberPhLength[fiber]) ;
     }
-  return this->GetTree ()->Fill () ; 
+  
+  int nBytes = this->GetTree ()->Fill () ; 
+  
+  if (ffile && fcheckpointInterval > 0 && ++feventsSinceCheckpoint >= fcheckpointInterval)
+    this->Checkpoint () ;
+  return nBytes ;
 }
 
 
@@ -78,24 +118,222 @@ bool CreateTree::Write ()
 // ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
 
+/**
+Direct the tree to a new output file, starting from an empty tree.
+*/
+bool CreateTree::OpenFile (TString fileName)
+{
+  this->CloseFile () ;
+  
+  TDirectory* currentDir = gDirectory ;
+  ffile = new TFile (fileName, "RECREATE") ;
+  currentDir->cd () ;
+  if (ffile->IsZombie ())
+    {
+      delete ffile ;
+      ffile = NULL ;
+      return false ;
+    }
+  
+  this->GetTree ()->Reset () ;
+  this->GetTree ()->SetDirectory (ffile) ;
+  feventsSinceCheckpoint = 0 ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Write the tree to the current output file and close it.
+The tree is detached from the file before closing it, so that it survives
+and can be directed to the next file.
+The master seed goes next to the tree: with the Event number it gives back
+the seeds of any event (see EventSeeder).
+The output is complete, the checkpoint is not needed any more.
+*/
+bool CreateTree::CloseFile ()
+{
+  if (!ffile) return false ;
+  
+  TDirectory* currentDir = (gDirectory == ffile) ? gROOT : gDirectory ;
+  ffile->cd () ;
+  // replaces the cycle saved by the last checkpoint
+  this->GetTree ()->Write ("", TObject::kOverwrite) ;
+  TNamed masterSeed ("masterSeed", Form ("%ld", EventSeeder::GetMasterSeed ())) ;
+  masterSeed.Write ("", TObject::kOverwrite) ;
+  remove (TString (ffile->GetName ()) + ".checkpoint") ;
+  this->GetTree ()->SetDirectory (0) ;
+  ffile->Close () ;
+  delete ffile ;
+  ffile = NULL ;
+  currentDir->cd () ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+bool CreateTree::WriteObject (TObject* object)
+{
+  if (!ffile) return false ;
+  
+  TDirectory* currentDir = gDirectory ;
+  ffile->cd () ;
+  object->Write () ;
+  currentDir->cd () ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The tree and the file header are saved first, the checkpoint file is then
+replaced in one go: if the job dies in between, the previous checkpoint
+still describes a consistent output.
+The random engine state is not saved, since every event is seeded
+from the master seed and its number (see EventSeeder).
+*/
+bool CreateTree::Checkpoint ()
+{
+  if (!ffile) return false ;
+  
+  TDirectory* currentDir = gDirectory ;
+  this->GetTree ()->AutoSave ("SaveSelf") ;
+  currentDir->cd () ;
+  feventsSinceCheckpoint = 0 ;
+  
+  TString checkpointName = TString (ffile->GetName ()) + ".checkpoint" ;
+  TString tmpName = checkpointName + ".tmp" ;
+  std::ofstream checkpointFile (tmpName.Data ()) ;
+  checkpointFile << "masterSeed " << EventSeeder::GetMasterSeed () << "\n"
+                 << "events "     << this->GetTree ()->GetEntries () << "\n" ;
+  checkpointFile.close () ;
+  if (!checkpointFile || rename (tmpName.Data (), checkpointName.Data ()) != 0)
+    {
+      cerr << "<CreateTree::Checkpoint>: cannot write " << checkpointName << endl ;
+      return false ;
+    }
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+bool CreateTree::ReadCheckpoint (TString fileName, Long64_t& masterSeed, Long64_t& eventsDone)
+{
+  std::ifstream checkpointFile ((fileName + ".checkpoint").Data ()) ;
+  std::string seedKey, eventsKey ;
+  checkpointFile >> seedKey >> masterSeed >> eventsKey >> eventsDone ;
+  return checkpointFile && seedKey == "masterSeed" && eventsKey == "events" ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The tree read from the file is the one saved by the last checkpoint,
+the events filled after it were lost with the job.
+It replaces the tree of this object, and is filled from its variables.
+*/
+Long64_t CreateTree::ResumeFile (TString fileName)
+{
+  Long64_t masterSeed, eventsDone ;
+  if (!ReadCheckpoint (fileName, masterSeed, eventsDone)) return -1 ;
+  
+  this->CloseFile () ;
+  
+  TDirectory* currentDir = gDirectory ;
+  ffile = new TFile (fileName, "UPDATE") ;
+  currentDir->cd () ;
+  TTree* tree = ffile->IsZombie () ? NULL : (TTree*) ffile->Get (fname) ;
+  if (!tree || tree->GetEntries () < eventsDone)
+    {
+      cerr << "<CreateTree::ResumeFile>: no tree with " << eventsDone << " events in " << fileName << endl ;
+      delete ffile ;
+      ffile = NULL ;
+      return -1 ;
+    }
+  
+  this->Attach (tree) ;
+  delete ftree ;
+  ftree = tree ;
+  feventsSinceCheckpoint = 0 ;
+  return tree->GetEntries () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void CreateTree::ReserveFibers (int nFibers)
+{
+  if (nFibers <= int (ffiberIsHit.size ())) return ;
+  ffiberIsHit.resize (nFibers, false) ;
+  ffiberPhotons.resize (nFibers, 0) ;
+  ffiberPhLength.resize (nFibers, 0.) ;
+  ffibersHit.reserve (nFibers) ;
+  fiberIndex->reserve (nFibers) ;
+  fiberPhotons->reserve (nFibers) ;
+  fiberPhLength->reserve (nFibers) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
 /**
 For each photon, record the full path length of that particular photon,
 according to the length passed to the function.
-In SteppingAction.cc, this length is calculated as the one traveled
+In FiberCoreSD.cc, this length is calculated as the one traveled
 in the core of each fiber, therefore this is the total length traveled
 in the fibers cores, for a single photon, per event.
+The lengths of the fibers and the weighted photon counts of the chamfers
+sum the photon weights, numPhotonsInChamfer and fiberPhotons count the photons.
 */
-void CreateTree::addPhoton (int trackId, float length, int chamferId)
+bool CreateTree::addPhoton (int trackId, float length, int chamferId, int fiberId, float weight)
 {
-  if (fsingleGammaInfo.find (trackId) == fsingleGammaInfo.end ())
+  // the per fiber sums are normally allocated by ReserveFibers
+  if (fiberId >= int (ffiberIsHit.size ())) this->ReserveFibers (fiberId + 1) ;
+  if (!ffiberIsHit[fiberId])
+    {
+      ffiberIsHit[fiberId] = true ;
+      ffibersHit.push_back (fiberId) ;
+    }
+  ffiberPhLength[fiberId] += weight * length ;
+  
+  if (trackId >= int (fsingleGammaInfo.size ()))
     {
-      fsingleGammaInfo[trackId] = std::pair<int, float> (chamferId, length) ;
+      PhotonInfo unseen = { -1, -1, 0. } ;
+      fsingleGammaInfo.resize (std::max (2 * fsingleGammaInfo.size (), size_t (trackId + 1)), unseen) ;
+    }
+  
+  PhotonInfo& info = fsingleGammaInfo[trackId] ;
+  if (info.chamfer < 0)
+    {
+      // first time the photon is seen: it counts for this chamfer and fiber
+      assert (chamferId < 4) ;
+      assert (chamferId >= 0) ;
+      info.chamfer = chamferId ;
+      info.fiber   = fiberId ;
+      info.length  = length ;
+      fphotonsSeen.push_back (trackId) ;
+      ++numPhotonsInChamfer[chamferId] ;
+      weightedPhotonsInChamfer[chamferId] += weight ;
+      ++ffiberPhotons[fiberId] ;
+      return true ;
     }
   else  
     {
-      fsingleGammaInfo[trackId].second += length ;
+      info.length += length ;
     }
-  return ;
+  return false ;
 }
 
 
@@ -105,10 +343,111 @@ void CreateTree::addPhoton (int trackId, float length, int chamferId)
 void CreateTree::Clear ()
 {
   Event	= 0 ;
+  Seed  = 0 ;
+  Seed2 = 0 ;
   for (int i = 0 ; i < 4 ; ++i) 
     {
       totalPhLengthInChamfer[i] = 0. ;
       numPhotonsInChamfer[i] = 0. ;
+      weightedPhotonsInChamfer[i] = 0. ;
+      fastPhLengthInChamfer[i] = 0. ;
+      numFastPhotonsInChamfer[i] = 0 ;
+    }
+  for (int i = 0 ; i < 3 ; ++i) 
+    numPhotonsKilled[i] = 0 ;
+  
+  // only the photons seen have to be reset, the memory is kept for the next event
+  for (unsigned int iPhoton = 0 ; iPhoton < fphotonsSeen.size () ; ++iPhoton)
+    fsingleGammaInfo[fphotonsSeen[iPhoton]].chamfer = -1 ;
+  fphotonsSeen.clear () ;
+  
+  // only the fibers hit have to be reset
+  for (unsigned int iHit = 0 ; iHit < ffibersHit.size () ; ++iHit)
+    {
+      int fiber = ffibersHit[iHit] ;
+      ffiberIsHit[fiber] = false ;
+      ffiberPhotons[fiber] = 0 ;
+      ffiberPhLength[fiber] = 0. ;
+    }
+  ffibersHit.clear () ;
+  fiberIndex->clear () ;
+  fiberPhotons->clear () ;
+  fiberPhLength->clear () ;
+  depositInLayer->assign (depositInLayer->size (), 0.) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Read an existing tree with the same branches of this one into its variables,
+used to copy entries between trees.
+*/
+void CreateTree::Attach (TTree* tree)
+{
+  tree->SetBranchAddress ("Event",                  &this->Event) ;
+  tree->SetBranchAddress ("Seed",                   &this->Seed) ;
+  tree->SetBranchAddress ("Seed2",                  &this->Seed2) ;
+  tree->SetBranchAddress ("ScanPoint",              &this->ScanPoint) ;
+  tree->SetBranchAddress ("ScintFraction",          &this->ScintFraction) ;
+  tree->SetBranchAddress ("totalPhLengthInChamfer", this->totalPhLengthInChamfer) ;
+  tree->SetBranchAddress ("numPhotonsInChamfer",    this->numPhotonsInChamfer) ;
+  tree->SetBranchAddress ("weightedPhotonsInChamfer", this->weightedPhotonsInChamfer) ;
+  tree->SetBranchAddress ("fastPhLengthInChamfer",  this->fastPhLengthInChamfer) ;
+  tree->SetBranchAddress ("numFastPhotonsInChamfer", this->numFastPhotonsInChamfer) ;
+  tree->SetBranchAddress ("numPhotonsKilled",       this->numPhotonsKilled) ;
+  tree->SetBranchAddress ("fiberIndex",             &this->fiberIndex) ;
+  tree->SetBranchAddress ("fiberPhotons",           &this->fiberPhotons) ;
+  tree->SetBranchAddress ("fiberPhLength",          &this->fiberPhLength) ;
+  tree->SetBranchAddress ("depositInLayer",         &this->depositInLayer) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Called by each worker thread when its user actions are built.
+Each worker writes its own output segment, merged by the master at the end of the job;
+without a file name the tree is kept in memory.
+The booking is serialised because ROOT registers new objects globally.
+*/
+CreateTree* CreateTree::CreateWorker (TString name, TString fileName)
+{
+#ifdef G4MULTITHREADED
+  G4AutoLock lock (&workersMutex) ;
+#endif
+  TDirectory* currentDir = gDirectory ;
+  
+  CreateTree* worker = new CreateTree (name) ;
+  worker->GetTree ()->SetDirectory (0) ;
+  if (fileName != "") worker->OpenFile (fileName) ;
+  fWorkers.push_back (worker) ;
+  
+  currentDir->cd () ;
+  return worker ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Called by the master once the worker threads are over.
+Returns the names of the files written.
+*/
+std::vector<TString> CreateTree::CloseWorkers ()
+{
+  std::vector<TString> fileNames ;
+  for (unsigned int iWorker = 0 ; iWorker < fWorkers.size () ; ++iWorker)
+    {
+      CreateTree* worker = fWorkers.at (iWorker) ;
+      if (worker->ffile) fileNames.push_back (worker->ffile->GetName ()) ;
+      worker->CloseFile () ;
+      delete worker->GetTree () ;
+      delete worker ;
     }
-  fsingleGammaInfo.clear () ;
+  fWorkers.clear () ;
+  return fileNames ;
 }
@@ -0,0 +1,74 @@
+#include "CrystalSD.hh"
+#include "LightCollectionTable.hh"
+#include "CreateTree.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4Material.hh"
+#include "G4MaterialPropertiesTable.hh"
+#include "G4LossTableManager.hh"
+#include "G4EmSaturation.hh"
+#include "G4Poisson.hh"
+#include "Randomize.hh"
+#include "CLHEP/Random/RandBinomial.h"
+
+
+
+CrystalSD::CrystalSD (const G4String& name) :
+  G4VSensitiveDetector (name)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+CrystalSD::~CrystalSD ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The mean number of photons is the light yield times the visible energy,
+with the Birks saturation; it fluctuates with a Poisson distribution below
+10 photons and a gaussian scaled by RESOLUTIONSCALE above, as in G4Scintillation.
+The photons are then shared among the chamfers with a multinomial distribution.
+*/
+G4bool CrystalSD::ProcessHits (G4Step* step, G4TouchableHistory*)
+{
+  const LightCollectionTable* table = LightCollectionTable::Instance () ;
+  if (!table || !table->IsLoaded ()) return false ;
+  if (step->GetTotalEnergyDeposit () <= 0.) return false ;
+  
+  G4MaterialPropertiesTable* properties = step->GetTrack ()->GetMaterial ()->GetMaterialPropertiesTable () ;
+  if (!properties || !properties->ConstPropertyExists ("SCINTILLATIONYIELD")) return false ;
+  G4double resolution = properties->ConstPropertyExists ("RESOLUTIONSCALE") ? 
+                        properties->GetConstProperty ("RESOLUTIONSCALE") : 1. ;
+  
+  G4EmSaturation* saturation = G4LossTableManager::Instance ()->EmSaturation () ;
+  G4double visible = saturation ? saturation->VisibleEnergyDeposition (step) : step->GetTotalEnergyDeposit () ;
+  G4double mean = properties->GetConstProperty ("SCINTILLATIONYIELD") * visible ;
+  G4int nPhotons = 0 ;
+  if (mean > 10.) nPhotons = std::max (0, G4int (G4RandGauss::shoot (mean, resolution * std::sqrt (mean)) + 0.5)) ;
+  else            nPhotons = G4int (G4Poisson (mean)) ;
+  if (nPhotons == 0) return false ;
+  
+  G4ThreeVector position = 0.5 * (step->GetPreStepPoint ()->GetPosition () + step->GetPostStepPoint ()->GetPosition ()) ;
+  const G4double* probability = table->GetProbabilities (position) ;
+  
+  CreateTree* tree = CreateTree::Instance () ;
+  G4double left = 1. ;
+  for (int chamfer = 0 ; chamfer < LightCollectionTable::kNChamfers && nPhotons > 0 && left > 0. ; ++chamfer)
+    {
+      G4int n = G4int (CLHEP::RandBinomial::shoot (nPhotons, std::min (1., probability[chamfer] / left))) ;
+      tree->numPhotonsInChamfer[chamfer] += n ;
+      tree->weightedPhotonsInChamfer[chamfer] += n ;
+      nPhotons -= n ;
+      left -= probability[chamfer] ;
+    }
+  return true ;
+}
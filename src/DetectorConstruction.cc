@@ -31,12 +31,42 @@
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 #include "DetectorConstruction.hh"
-
-
-
-DetectorConstruction::DetectorConstruction (const string& configFileName)
+#include <algorithm>
+#include "StartupProfiler.hh"
+#include "FiberCoreSD.hh"
+#include "G4SDManager.hh"
+#include "FiberTransportModel.hh"
+#include "LightCollectionTable.hh"
+#include "CrystalSD.hh"
+#include "FiberParameterisation.hh"
+#include "FiberLayout.hh"
+#include "FiberLayoutCache.hh"
+#include "G4PVParameterised.hh"
+#include "G4Transform3D.hh"
+#include <cfloat>
+#include <sstream>
+#include "G4Region.hh"
+#include "G4RegionStore.hh"
+#include "G4MaterialPropertiesTable.hh"
+#include <cstdlib>
+#include <sys/stat.h>
+#ifdef G4LIB_USE_GDML
+#include "G4GDMLParser.hh"
+#endif
+
+
+
+DetectorConstruction::DetectorConstruction (const string& configFileName) :
+  fAbsorberPV (NULL),
+  fCrystalPV (NULL),
+  AirMaterial (NULL),
+  AbMaterial (NULL),
+  ScMaterial (NULL),
+  CoMaterial (NULL),
+  ClMaterial (NULL)
 {
-  readConfigFile (configFileName) ;
+  ConfigFile config (configFileName) ;
+  readConfig (config) ;
   
   
   
@@ -44,17 +74,18 @@ DetectorConstruction::DetectorConstruction (const string& configFileName)
   //------------- Parameters --------------
   //---------------------------------------
   
-  initializeMaterials () ;
+  // the materials of a loaded geometry come with it
+  if (gdml_load == "")
+    {
+      StartupProfiler::BeginPhase ("materials") ;
+      initializeMaterials () ;
+      setScintillatorProperties () ;
+      StartupProfiler::EndPhase ("materials") ;
+    }
   
   expHall_x = expHall_y = expHall_z = 1*m ;
   
-  spacing_z = abs_d + crystal_d ;
-  
-  module_x = module_xy ;
-  module_y = module_xy ;
-  module_z = (nLayers_z) * spacing_z ;
-  
-  fiber_length = module_z ;
+  computeDimensions () ;
 }
 
 
@@ -62,7 +93,10 @@ DetectorConstruction::DetectorConstruction (const string& configFileName)
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 DetectorConstruction::~DetectorConstruction ()
-{}
+{
+  for (unsigned int iParam = 0 ; iParam < fFiberParameterisations.size () ; ++iParam)
+    delete fFiberParameterisations.at (iParam) ;
+}
 
 
 
@@ -71,6 +105,28 @@ DetectorConstruction::~DetectorConstruction ()
 G4VPhysicalVolume* DetectorConstruction::Construct ()
 {
   G4cout << ">>>>>> DetectorConstruction::Construct ()::begin <<<<<<" << G4endl ;
+  StartupProfiler::BeginPhase ("geometry construction") ;
+  
+  // the geometry may be built again with new parameters
+  for (unsigned int iParam = 0 ; iParam < fFiberParameterisations.size () ; ++iParam)
+    delete fFiberParameterisations.at (iParam) ;
+  fFiberParameterisations.clear () ;
+  fFiberTable.Clear () ;
+  fFiberCoreLV.clear () ;
+  
+  if (gdml_load != "")
+    {
+      G4VPhysicalVolume* worldPV = loadGDML () ;
+      fFiberTable.BuildSearchGrid () ;
+      if (worldPV) constructFiberRegion () ;
+#ifndef G4MULTITHREADED
+      if (worldPV) ConstructSDandField () ;
+#endif
+      G4cout << ">>>>>> DetectorConstruction: " << fFiberTable.GetNFibers () << " fibers loaded <<<<<<" << G4endl ;
+      StartupProfiler::EndPhase ("geometry construction") ;
+      G4cout << ">>>>>> DetectorConstruction::Construct ()::end <<< " << G4endl ;
+      return worldPV ;
+    }
   
   
   
@@ -85,19 +141,21 @@ G4VPhysicalVolume* DetectorConstruction::Construct ()
   
   // The experimental Hall
   G4VSolid* worldS = new G4Box ("World", 0.5*expHall_x, 0.5*expHall_y, 0.5*expHall_z) ;
-  G4LogicalVolume* worldLV = new G4LogicalVolume (worldS, MyMaterials::Air (), "World", 0, 0, 0) ;
+  G4LogicalVolume* worldLV = new G4LogicalVolume (worldS, AirMaterial, "World", 0, 0, 0) ;
   G4VPhysicalVolume* worldPV = new G4PVPlacement (0, G4ThreeVector (), worldLV, "World", 0, false, 0, true) ;
   
   
   // The calorimeter
-  G4VSolid* calorS = new G4Box ("Calorimeter", 0.5*module_xy, 0.5*module_xy, 0.5*module_z) ;
-  G4LogicalVolume* calorLV = new G4LogicalVolume (calorS, MyMaterials::Air (), "Calorimeter") ;
+  //      Its section is the one of the crystals, so that the corners out of the chamfers
+  //      are left to the fiber bundles, each one in its own mother volume, see placeFiberBundle.
+  G4VSolid* calorS = new G4ExtrudedSolid ("Calorimeter", crystalBase, 0.5*module_z, G4TwoVector (0., 0.), 1., G4TwoVector (0., 0.), 1.) ;
+  G4LogicalVolume* calorLV = new G4LogicalVolume (calorS, AirMaterial, "Calorimeter") ;
   new G4PVPlacement (0, G4ThreeVector (), calorLV, "Calorimeter", worldLV, false, 0, true) ;
   
   
   // A layer
-  G4VSolid* layerS = new G4Box ("Layer", 0.5*module_xy, 0.5*module_xy, 0.5*spacing_z) ;
-  G4LogicalVolume* layerLV = new G4LogicalVolume (layerS, MyMaterials::Air (), "Layer") ;
+  G4VSolid* layerS = new G4ExtrudedSolid ("Layer", crystalBase, 0.5*spacing_z, G4TwoVector (0., 0.), 1., G4TwoVector (0., 0.), 1.) ;
+  G4LogicalVolume* layerLV = new G4LogicalVolume (layerS, AirMaterial, "Layer") ;
   new G4PVReplica ("Layer", layerLV, calorLV, kZAxis, nLayers_z, spacing_z) ;
   
   
@@ -114,215 +172,66 @@ G4VPhysicalVolume* DetectorConstruction::Construct ()
   // Fibers
   //      The core is divided into two sub-cores, made of the same material.
   //      This does not change at all the physics, but eases the check for where the photon is passing through.
+  //      The three volumes are nested, the inner core in the outer one and this in the cladding,
+  //      so that the fibers of a chamfer are the copies of a single parameterised cladding,
+  //      see placeFiberBundle: the boundaries seen by the photons are the same as with three rings.
  
-  G4VSolid* fiberCoreInsS = new G4Tubs ("FiberCoreIns", 0.                       , fiberCore_radius * 0.9999, 0.5*fiber_length, 0.*deg, 360.*deg) ;
-  G4VSolid* fiberCoreOutS = new G4Tubs ("FiberCoreOut", fiberCore_radius * 0.9999, fiberCore_radius         , 0.5*fiber_length, 0.*deg, 360.*deg) ;
-  G4VSolid* fiberCladS    = new G4Tubs ("FiberClad"   , fiberCore_radius         , fiberClad_radius         , 0.5*fiber_length, 0.*deg, 360.*deg) ;
+  G4VSolid* fiberCoreInsS = new G4Tubs ("FiberCoreIns", 0., fiberCore_radius * 0.9999, 0.5*fiber_length, 0.*deg, 360.*deg) ;
+  G4VSolid* fiberCoreOutS = new G4Tubs ("FiberCoreOut", 0., fiberCore_radius         , 0.5*fiber_length, 0.*deg, 360.*deg) ;
+  G4VSolid* fiberCladS    = new G4Tubs ("FiberClad"   , 0., fiberClad_radius         , 0.5*fiber_length, 0.*deg, 360.*deg) ;
   
 
-  G4double offset_x = 0. ;
-  G4double offset_y = 0. ;
-
-  //PG first edge: chessboard disposition
+  //PG the first edge has rows of fibers, the second a single row, the third the most compact
+  //PG disposition possible and the fourth a single large fiber, see FiberLayout
   //PG ---- ---- ---- ---- ---- ---- ---- ---- ---- 
-
-  G4LogicalVolume* fiberCoreInsLV_0 = new G4LogicalVolume (fiberCoreInsS, CoMaterial, "FiberCoreIns_0") ;
-  G4LogicalVolume* fiberCoreOutLV_0 = new G4LogicalVolume (fiberCoreOutS, CoMaterial, "FiberCoreOut_0") ;
-  G4LogicalVolume* fiberCladLV_0    = new G4LogicalVolume (fiberCladS,    ClMaterial, "FiberClad_0") ;
-
-  fFiberCoreInsPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCoreOutPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCladPV.push_back    (std::vector <G4VPhysicalVolume*> ()) ;
-
-  int edge = 0 ;
-  std::pair<G4TwoVector, G4TwoVector> theChamfer = getChamfer (crystalBase, edge) ;
-
-  int nTotFibers = 0 ;  
-  int numberOfRadius = 1 ;
-  while (1)
-  {
-    int fibersNumberInFirstRow = floor ( 
-      ( (theChamfer.first - theChamfer.second).mag () - 2.* numberOfRadius * fiberClad_radius ) / // length of the usable line
-      (2 * fiberClad_radius)                                                                     // transverse length of a single fiber
-      ) ;
-    if ( fibersNumberInFirstRow <= 0 ) break ;
-    
-    G4double offset_x = 0. ;
-    G4double offset_y = 0. ;
-    
-    //PG put the first fiber
-    G4TwoVector fiberAxisPosition = centerOfTheFirstFiber (theChamfer, fibersNumberInFirstRow, fiberClad_radius, numberOfRadius) ;
-    fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_0, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-    fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_0, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-    fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_0, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;
-    ++nTotFibers ;
-    
-    //PG add the following fibers in the line
-    for (int i = 1 ; i < fibersNumberInFirstRow ; ++i)
+  
+  FiberLayout layout (crystalBase) ;
+  layout.SetDefaultPolicies (fiberClad_radius) ;
+  FiberLayoutCache layoutCache (fiberLayout_cache, module_xy, chamfer, fiberClad_radius, fiberCore_radius) ;
+  const FiberLayout::Fiber* fibers = NULL ;
+  G4int nFibers = 0 ;
+  if (layoutCache.Map ())
     {
-      fiberAxisPosition = getNextCenter (theChamfer, fiberAxisPosition, fiberClad_radius) ;
-      fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_0, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-      fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_0, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-      fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_0, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;  
-      ++nTotFibers ;
+      fibers = layoutCache.GetFibers () ;
+      nFibers = layoutCache.GetNFibers () ;
     }
-    
-    numberOfRadius += 2 ;
-  } // while
-
-  //PG second edge: a single line
-  //PG ---- ---- ---- ---- ---- ---- ---- ---- ---- 
-
-  G4LogicalVolume* fiberCoreInsLV_1 = new G4LogicalVolume (fiberCoreInsS, CoMaterial, "FiberCoreIns_1") ;
-  G4LogicalVolume* fiberCoreOutLV_1 = new G4LogicalVolume (fiberCoreOutS, CoMaterial, "FiberCoreOut_1") ;
-  G4LogicalVolume* fiberCladLV_1    = new G4LogicalVolume (fiberCladS,    ClMaterial, "FiberClad_1"   ) ;
-
-  fFiberCoreInsPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCoreOutPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCladPV.push_back    (std::vector <G4VPhysicalVolume*> ()) ;
-
-  edge = 1 ;
-  theChamfer = getChamfer (crystalBase, edge) ;
-
-  numberOfRadius = 1 ;
-  int fibersNumberInFirstRow = floor ( 
-    ( (theChamfer.first - theChamfer.second).mag () - 2.* numberOfRadius * fiberClad_radius ) / // length of the usable line
-    (2 * fiberClad_radius)                                                                     // transverse length of a single fiber
-    ) ;
-
-  //PG put the first fiber
-  G4TwoVector fiberAxisPosition = centerOfTheFirstFiber (theChamfer, fibersNumberInFirstRow, fiberClad_radius, numberOfRadius) ;
-  fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_1, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-  fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_1, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-  fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_1, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;
+  else
+    {
+      const std::vector<FiberLayout::Fiber>& computed = layout.Compute () ;
+      layoutCache.Store (computed) ;
+      if (!computed.empty ()) fibers = &computed[0] ;
+      nFibers = computed.size () ;
+    }
+  for (G4int iFiber = 0 ; iFiber < nFibers ; ++iFiber)
+    placeFiber (G4TwoVector (fibers[iFiber].x, fibers[iFiber].y), fibers[iFiber].chamfer) ;
   
-  //PG add the following fibers in the line
-  for (int i = 1 ; i < fibersNumberInFirstRow ; ++i)
-  {
-    fiberAxisPosition = getNextCenter (theChamfer, fiberAxisPosition, fiberClad_radius) ;
-    fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_1, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-    fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_1, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-    fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_1, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;
-  }
+  G4double bigfiberClad_radius = layout.GetRadius (3) ;
+  G4double bigfiberCore_radius = 0.5 * bigfiberClad_radius ;
   
-  //PG third edge: the most compact disposition is possible
-  //PG ---- ---- ---- ---- ---- ---- ---- ---- ---- 
-
-  G4LogicalVolume* fiberCoreInsLV_2 = new G4LogicalVolume (fiberCoreInsS, CoMaterial, "FiberCoreIns_2") ;
-  G4LogicalVolume* fiberCoreOutLV_2 = new G4LogicalVolume (fiberCoreOutS, CoMaterial, "FiberCoreOut_2") ;
-  G4LogicalVolume* fiberCladLV_2    = new G4LogicalVolume (fiberCladS,    ClMaterial, "FiberClad_2"   ) ;
-
-  fFiberCoreInsPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCoreOutPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCladPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-
-  edge = 2 ;
-  theChamfer = getChamfer (crystalBase, edge) ;
-
-  fibersNumberInFirstRow = floor (
-      (    (theChamfer.first - theChamfer.second).mag () - 2 * fiberClad_radius * 1.41421356237)   // length of the usable line
-        /  (2 * fiberClad_radius)   // length of a single fibre
-    ) ;
-
-  numberOfRadius = 1 ;
-  //PG put the first fiber
-  fiberAxisPosition = centerOfTheFirstFiberPG (theChamfer, fibersNumberInFirstRow, fiberClad_radius) ;
-  G4TwoVector firstFiberInRowCenter = fiberAxisPosition ;
-  fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_2, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-  fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_2, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-  fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_2, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;
+  G4VSolid* bigfiberCoreInsS = new G4Tubs ("bigfiberCoreIns", 0., bigfiberCore_radius * 0.9999, 0.5*fiber_length, 0.*deg, 360.*deg) ;
+  G4VSolid* bigfiberCoreOutS = new G4Tubs ("bigfiberCoreOut", 0., bigfiberCore_radius, 0.5*fiber_length, 0.*deg, 360.*deg) ;
+  G4VSolid* bigfiberCladS = new G4Tubs ("bigfiberClad", 0., bigfiberClad_radius, 0.5*fiber_length, 0.*deg, 360.*deg) ;
   
-  //PG add the following fibers in the first line
-  for (int i = 1 ; i < fibersNumberInFirstRow ; ++i)
+  G4LogicalVolume* fiberCoreInsLV[FiberLayout::kNChamfers] ;
+  G4LogicalVolume* fiberCoreOutLV[FiberLayout::kNChamfers] ;
+  G4LogicalVolume* fiberCladLV[FiberLayout::kNChamfers] ;
+  for (int edge = 0 ; edge < FiberLayout::kNChamfers ; ++edge)
     {
-      fiberAxisPosition = getNextCenter (theChamfer, fiberAxisPosition, fiberClad_radius) ;
-      fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_2, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-      fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_2, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-      fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_2, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;
-    }
-
-  G4TwoVector chamferDirection = theChamfer.second - theChamfer.first ;
-  G4TwoVector chamferOrtogonal = chamferDirection ;
-  chamferDirection *= 1. / chamferDirection.mag () ; 
-  chamferOrtogonal.setX (chamferDirection.y ()) ;
-  chamferOrtogonal.setY (-1 * chamferDirection.x ()) ;
-
-  int safetyCounter = 0 ;
-  do {
-      ++safetyCounter ;
-      // put the first fibre of the second row
-      fiberAxisPosition = centerOfTheFirstFibreOnSecondLayer (theChamfer, fiberClad_radius, firstFiberInRowCenter) ;
-      firstFiberInRowCenter = fiberAxisPosition ;
-
-      if (chamferOrtogonal.dot (fiberAxisPosition - theChamfer.second) > 0.5 * chamfer)
-        { 
-          //PG no more lines of fibres can be put FIXME
-          break ;
-        }
-
-      if (checkIfOutOfChamfer (fiberClad_radius, fiberAxisPosition, crystalBase, 2)) 
+      if (layout.GetPolicy (edge) == FiberLayout::kSingleLarge)
         {
-          fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_2, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-          fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_2, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-          fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_2, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;
+          fiberCoreInsLV[edge] = new G4LogicalVolume (bigfiberCoreInsS, CoMaterial, Form ("fiberCoreIns_%d", edge)) ;
+          fiberCoreOutLV[edge] = new G4LogicalVolume (bigfiberCoreOutS, CoMaterial, Form ("fiberCoreOut_%d", edge)) ;
+          fiberCladLV[edge]    = new G4LogicalVolume (bigfiberCladS,    ClMaterial, Form ("fiberClad_%d", edge)) ;
         }
-
-      //PG add the following fibres in the line
-      for (int i = 1 ; i < fibersNumberInFirstRow ; ++i)
+      else
         {
-          fiberAxisPosition = getNextCenter (theChamfer, fiberAxisPosition, fiberClad_radius) ;
-          if (checkIfOutOfChamfer (fiberClad_radius, fiberAxisPosition, crystalBase, 2)) 
-            {
-              fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreInsLV_2, Form ("FiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-              fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCoreOutLV_2, Form ("FiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-              fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), fiberCladLV_2, Form ("FiberClad%d", edge), worldLV, false, 0, false)) ;
-            }
-          else
-            { continue ; }  
+          fiberCoreInsLV[edge] = new G4LogicalVolume (fiberCoreInsS, CoMaterial, Form ("FiberCoreIns_%d", edge)) ;
+          fiberCoreOutLV[edge] = new G4LogicalVolume (fiberCoreOutS, CoMaterial, Form ("FiberCoreOut_%d", edge)) ;
+          fiberCladLV[edge]    = new G4LogicalVolume (fiberCladS,    ClMaterial, Form ("FiberClad_%d", edge)) ;
         }
-     }  
-   while (safetyCounter < 20) ;
-   if (safetyCounter > 20)
-     {
-       std::cout << "WARNING: abnormal termination of loop in filling the third chamfer" << std::endl ;
-     }
-
-  //PG fourth edge: a single large fiber
-  //PG ---- ---- ---- ---- ---- ---- ---- ---- ---- 
-
-  float bigfiberClad_radius = chamfer * 1.73205080757 * 0.125 ;
-  bigfiberClad_radius *= 0.95 ;
-  float bigfiberCore_radius = 0.5 * bigfiberClad_radius ;
-
-  G4VSolid* bigfiberCoreInsS = new G4Tubs ("bigfiberCoreIns", 0., bigfiberCore_radius * 0.9999, 0.5*fiber_length, 0.*deg, 360.*deg) ;
-  G4VSolid* bigfiberCoreOutS = new G4Tubs ("bigfiberCoreOut", bigfiberCore_radius * 0.9999, bigfiberCore_radius, 0.5*fiber_length, 0.*deg, 360.*deg) ;
-  G4VSolid* bigfiberCladS = new G4Tubs ("bigfiberClad", bigfiberCore_radius, bigfiberClad_radius, 0.5*fiber_length, 0.*deg, 360.*deg) ;
-  
-  G4LogicalVolume* bigfiberCoreInsLV = new G4LogicalVolume (bigfiberCoreInsS, CoMaterial, "fiberCoreIns_3") ;
-  G4LogicalVolume* bigfiberCoreOutLV = new G4LogicalVolume (bigfiberCoreOutS, CoMaterial, "fiberCoreOut_3") ;
-  G4LogicalVolume* bigfiberCladLV = new G4LogicalVolume (bigfiberCladS, ClMaterial, "fiberClad_3") ;
-
-  fFiberCoreInsPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCoreOutPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-  fFiberCladPV.push_back (std::vector <G4VPhysicalVolume*> ()) ;
-
-  // find the center
-  
-  edge = 3 ;
-  theChamfer = getChamfer (crystalBase, edge) ;
-
-  chamferDirection = theChamfer.second - theChamfer.first ;
-  chamferOrtogonal = chamferDirection ;
-  chamferDirection *= 1. / chamferDirection.mag () ; 
-  chamferOrtogonal.setX (chamferDirection.y ()) ;
-  chamferOrtogonal.setY (-1 * chamferDirection.x ()) ;
-  
-  fiberAxisPosition = theChamfer.first 
-      + 0.5 * chamfer * chamferDirection
-      + bigfiberClad_radius * chamferOrtogonal ;
-  fFiberCoreInsPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), bigfiberCoreInsLV, Form ("BigFiberCoreIns%d", edge), worldLV, false, 0, false)) ;
-  fFiberCoreOutPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), bigfiberCoreOutLV, Form ("BigFiberCoreOut%d", edge), worldLV, false, 0, false)) ;
-  fFiberCladPV.back ().push_back (new G4PVPlacement (0, G4ThreeVector (offset_x+fiberAxisPosition.x (), offset_y+fiberAxisPosition.y (), 0.), bigfiberCladLV, Form ("BigFiberClad%d", edge), worldLV, false, 0, false)) ;
+      placeFiberBundle (edge, layout.GetDirection (edge), fiberCoreInsLV[edge], fiberCoreOutLV[edge], fiberCladLV[edge], worldLV,
+                        layout.GetPolicy (edge) == FiberLayout::kSingleLarge ? "BigFiber" : "Fiber") ;
+    }
   
   //-----------------------------------------------------
   //------------- Visualization attributes --------------
@@ -368,23 +277,29 @@ G4VPhysicalVolume* DetectorConstruction::Construct ()
   G4VisAttributes* VisAttFiberCore = new G4VisAttributes (green) ;
   VisAttFiberCore->SetVisibility (true) ;
   VisAttFiberCore->SetForceWireframe (false) ;
-  fiberCoreInsLV_0->SetVisAttributes (VisAttFiberCore) ;  
-  fiberCoreOutLV_0->SetVisAttributes (VisAttFiberCore) ;  
-  fiberCoreInsLV_1->SetVisAttributes (VisAttFiberCore) ;  
-  fiberCoreOutLV_1->SetVisAttributes (VisAttFiberCore) ;  
-  fiberCoreInsLV_2->SetVisAttributes (VisAttFiberCore) ;  
-  fiberCoreOutLV_2->SetVisAttributes (VisAttFiberCore) ;  
-  bigfiberCoreInsLV->SetVisAttributes (VisAttFiberCore) ;  
-  bigfiberCoreOutLV->SetVisAttributes (VisAttFiberCore) ;  
+  for (int edge = 0 ; edge < FiberLayout::kNChamfers ; ++edge)
+    {
+      fiberCoreInsLV[edge]->SetVisAttributes (VisAttFiberCore) ;  
+      fiberCoreOutLV[edge]->SetVisAttributes (VisAttFiberCore) ;  
+    }
   
   G4VisAttributes* VisAttFiberClad = new G4VisAttributes (cyan) ;
   VisAttFiberClad->SetVisibility (true) ;
   VisAttFiberClad->SetForceWireframe (false) ;
-  fiberCladLV_0->SetVisAttributes (VisAttFiberClad) ;  
-  fiberCladLV_1->SetVisAttributes (VisAttFiberClad) ;  
-  fiberCladLV_2->SetVisAttributes (VisAttFiberClad) ;  
-  bigfiberCladLV->SetVisAttributes (VisAttFiberClad) ;  
+  for (int edge = 0 ; edge < FiberLayout::kNChamfers ; ++edge)
+    fiberCladLV[edge]->SetVisAttributes (VisAttFiberClad) ;  
   
+  fFiberTable.BuildSearchGrid () ;
+  if (gdml_export != "") exportGDML (worldPV) ;
+  constructFiberRegion () ;
+  
+#ifndef G4MULTITHREADED
+  // with threads, the kernel calls it in each worker
+  ConstructSDandField () ;
+#endif
+  
+  G4cout << ">>>>>> DetectorConstruction: " << fFiberTable.GetNFibers () << " fibers placed <<<<<<" << G4endl ;
+  StartupProfiler::EndPhase ("geometry construction") ;
   G4cout << ">>>>>> DetectorConstruction::Construct ()::end <<< " << G4endl ;
   return worldPV ;
 }
@@ -393,10 +308,8 @@ G4VPhysicalVolume* DetectorConstruction::Construct ()
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-void DetectorConstruction::readConfigFile (string configFileName)
+void DetectorConstruction::readConfig (const ConfigFile& config)
 {	
-  ConfigFile config (configFileName) ;
-  
   config.readInto (chamfer, "chamfer") ;
   config.readInto (module_xy, "module_xy") ;
   config.readInto (nLayers_z, "nLayers_z") ;
@@ -415,12 +328,442 @@ void DetectorConstruction::readConfigFile (string configFileName)
   config.readInto (fiberClad_material, "fiberClad_material") ;
   config.readInto (fiberClad_radius, "fiberClad_radius") ;
   config.readInto (fiber_length, "fiber_length") ;
+  fiberFastSim = config.read<int> ("fiberFastSim", 0) ;
+  fiberLayout_cache = config.read<std::string> ("fiberLayoutCache", "") ;
+  
+  gdml_export = config.read<std::string> ("gdml_export", "") ;
+  gdml_load   = config.read<std::string> ("gdml_load", "") ;
+  
+  lightTable_mode = config.read<int> ("lightTable_mode", 0) ;
+  lightTable_dir  = config.read<std::string> ("lightTable_dir", "lightTables") ;
+  lightTable_bins.clear () ;
+  config.readIntoVect (lightTable_bins, "lightTable_bins") ;
   
   config.readInto (depth, "depth") ;
 }
 
 
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::computeDimensions ()
+{
+  spacing_z = abs_d + crystal_d ;
+  
+  module_x = module_xy ;
+  module_y = module_xy ;
+  module_z = (nLayers_z) * spacing_z ;
+  
+  fiber_length = module_z ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/**
+Read a new configuration and report what it invalidates:
+- new materials are built only if a material choice changed,
+  otherwise the existing ones (and the physics tables built for them) are kept;
+- the scintillator optical properties are changed in place, 
+  since they are read by the optical processes at tracking time;
+- the geometry has to be built again if any dimension or material changed.
+*/
+G4int DetectorConstruction::UpdateConfig (const ConfigFile& config)
+{
+  // a loaded geometry comes with its materials, built from the parameters it was exported with
+  if (gdml_load != "")
+    {
+      G4cerr << "<DetectorConstruction::UpdateConfig>: the geometry is loaded from " << gdml_load 
+             << ", the detector configuration cannot be changed" << G4endl ;
+      return kNothingChanged ;
+    }
+  
+  std::vector<G4double> oldMaterials = materialParameters () ;
+  std::vector<G4double> oldOptics    = opticsParameters () ;
+  std::vector<G4double> oldGeometry  = geometryParameters () ;
+  readConfig (config) ;
+  computeDimensions () ;
+  
+  // going back to a material default needs a fresh material
+  bool restoreDefaults = false ;
+  std::vector<G4double> newOptics = opticsParameters () ;
+  for (unsigned int i = 0 ; i < newOptics.size () ; ++i)
+    if ( newOptics.at (i) < 0 && oldOptics.at (i) >= 0 ) restoreDefaults = true ;
+  
+  G4int changes = kNothingChanged ;
+  if ( materialParameters () != oldMaterials || restoreDefaults )
+  {
+    initializeMaterials () ;
+    changes |= kMaterialsChanged | kGeometryChanged ;
+  }
+  
+  if ( opticsParameters () != oldOptics || (changes & kMaterialsChanged) )
+  {
+    setScintillatorProperties () ;
+    changes |= kOpticsChanged ;
+  }
+  
+  if ( geometryParameters () != oldGeometry ) changes |= kGeometryChanged ;
+  
+  return changes ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/**
+The keys of the material, optics and geometry parameters compared by UpdateConfig,
+and the layout cache used by the rebuilt geometry.
+*/
+G4bool DetectorConstruction::IsUpdatable (const std::string& key)
+{
+  static const char* keys[] = { "chamfer", "module_xy", "nLayers_z", "abs_material", "abs_d",
+                                "crystal_material", "crystal_risetime", "crystal_abslength", "crystal_lightyield", "crystal_d",
+                                "fiberCore_material", "fiberCore_radius", "fiberClad_material", "fiberClad_radius",
+                                "depth", "fiberLayoutCache" } ;
+  for (unsigned int i = 0 ; i < sizeof (keys) / sizeof (keys[0]) ; ++i)
+    if (key == keys[i]) return true ;
+  return false ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/**
+The fiber cores are sensitive, the detector is made once
+and attached again to the cores of a rebuilt geometry.
+*/
+void DetectorConstruction::ConstructSDandField ()
+{
+  G4SDManager* SDManager = G4SDManager::GetSDMpointer () ;
+  FiberCoreSD* fiberCoreSD = (FiberCoreSD*) SDManager->FindSensitiveDetector ("FiberCore", false) ;
+  if (!fiberCoreSD)
+    {
+      fiberCoreSD = new FiberCoreSD ("FiberCore", &fFiberTable) ;
+      SDManager->AddNewDetector (fiberCoreSD) ;
+    }
+  
+  for (unsigned int iLV = 0 ; iLV < fFiberCoreLV.size () ; ++iLV)
+    fFiberCoreLV.at (iLV)->SetSensitiveDetector (fiberCoreSD) ;
+  
+  if (lightTable_mode > 0) constructLightTable () ;
+  else delete LightCollectionTable::Instance () ;
+  
+  if (fiberFastSim <= 0) return ;
+  
+  // the fast simulation manager of a region is per thread: each thread makes its model once
+  G4Region* fiberRegion = G4RegionStore::GetInstance ()->GetRegion ("FiberCores", false) ;
+  if (fiberRegion && !fiberRegion->GetFastSimulationManager ())
+    new FiberTransportModel ("FiberTransport", fiberRegion, &fFiberTable, fiberFastSim == 2) ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/**
+The cores are the envelopes of the fast simulation. The region is shared by the
+threads, so it is made and filled here, by Construct, on the master only.
+*/
+void DetectorConstruction::constructFiberRegion ()
+{
+  if (fiberFastSim <= 0) return ;
+  
+  G4Region* fiberRegion = G4RegionStore::GetInstance ()->GetRegion ("FiberCores", false) ;
+  if (!fiberRegion) fiberRegion = new G4Region ("FiberCores") ;
+  for (unsigned int iLV = 0 ; iLV < fFiberCoreLV.size () ; ++iLV)
+    fiberRegion->AddRootLogicalVolume (fFiberCoreLV.at (iLV)) ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/**
+The table is made again for each geometry, its key lists all
+the parameters of the detector description; in fast mode the
+crystals become sensitive and sample the light of the chamfers.
+*/
+void DetectorConstruction::constructLightTable ()
+{
+  std::ostringstream key ;
+  key.precision (10) ;
+  std::vector<G4double> parameters = geometryParameters () ;
+  key << "geometry" ;
+  for (unsigned int i = 0 ; i < parameters.size () ; ++i) key << " " << parameters.at (i) ;
+  parameters = materialParameters () ;
+  key << "\nmaterials" ;
+  for (unsigned int i = 0 ; i < parameters.size () ; ++i) key << " " << parameters.at (i) ;
+  parameters = opticsParameters () ;
+  key << "\noptics" ;
+  for (unsigned int i = 0 ; i < parameters.size () ; ++i) key << " " << parameters.at (i) ;
+  key << "\n" ;
+  
+  LightCollectionTable* table = new LightCollectionTable ((LightCollectionTable::Mode) lightTable_mode, lightTable_dir, key.str (),
+                                                          lightTable_bins, G4ThreeVector (module_x, module_y, spacing_z), -0.5*module_z) ;
+  if (lightTable_mode != LightCollectionTable::kFast) return ;
+  if (!table->Load ()) return ;
+  
+  G4SDManager* SDManager = G4SDManager::GetSDMpointer () ;
+  CrystalSD* crystalSD = (CrystalSD*) SDManager->FindSensitiveDetector ("Crystal", false) ;
+  if (!crystalSD)
+    {
+      crystalSD = new CrystalSD ("Crystal") ;
+      SDManager->AddNewDetector (crystalSD) ;
+    }
+  fCrystalPV->GetLogicalVolume ()->SetSensitiveDetector (crystalSD) ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::ReleaseRegions ()
+{
+  G4Region* fiberRegion = G4RegionStore::GetInstance ()->GetRegion ("FiberCores", false) ;
+  if (!fiberRegion) return ;
+  for (unsigned int iLV = 0 ; iLV < fFiberCoreLV.size () ; ++iLV)
+    fiberRegion->RemoveRootLogicalVolume (fFiberCoreLV.at (iLV), false) ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/**
+Add a fiber at the given transverse position to the table,
+its volumes are placed with the ones of its chamfer by placeFiberBundle.
+*/
+void DetectorConstruction::placeFiber (const G4TwoVector& position, const int& chamfer)
+{
+  fFiberTable.AddFiber (chamfer, position) ;
+}
+
+
+/**
+Place the fibers of a chamfer, the last ones added to the table, as a single
+parameterised cladding with the outer and inner cores as daughters.
+The parameterised volume has to be the only daughter of its mother, so the bundle
+gets its own envelope, a box of the mother material along the direction of the chamfer
+and tight around the fibers. The fibers are out of the chamfer by at least their radius,
+so the box does not cross the plane of the chamfer and does not overlap the calorimeter,
+whose section is the one of the crystals: the navigation in the fibers is confined to it.
+The table gets the three volumes, with the depth of the parameterised one in the touchables of each.
+*/
+void DetectorConstruction::placeFiberBundle (const int& chamfer, const G4TwoVector& direction,
+                                             G4LogicalVolume* coreInsLV, G4LogicalVolume* coreOutLV, G4LogicalVolume* cladLV,
+                                             G4LogicalVolume* motherLV, const G4String& name)
+{
+  G4int lastFiber = fFiberTable.GetNFibers () - 1 ;
+  G4int firstFiber = lastFiber + 1 ;
+  while (firstFiber > 0 && fFiberTable.GetChamfer (firstFiber - 1) == chamfer) --firstFiber ;
+  G4int nFibers = lastFiber - firstFiber + 1 ;
+  if (nFibers <= 0) return ;
+  
+  // the frame of the chamfer: u along it, v orthogonal to it
+  G4TwoVector u = direction.unit () ;
+  G4TwoVector v (-u.y (), u.x ()) ;
+  G4double uMin = DBL_MAX, uMax = -DBL_MAX, vMin = DBL_MAX, vMax = -DBL_MAX ;
+  for (G4int fiber = firstFiber ; fiber <= lastFiber ; ++fiber)
+    {
+      const G4TwoVector& position = fFiberTable.GetPosition (fiber) ;
+      uMin = std::min (uMin, position * u) ; uMax = std::max (uMax, position * u) ;
+      vMin = std::min (vMin, position * v) ; vMax = std::max (vMax, position * v) ;
+    }
+  G4TwoVector centre = 0.5 * (uMin + uMax) * u + 0.5 * (vMin + vMax) * v ;
+  
+  std::vector<G4ThreeVector> positions ;
+  for (G4int fiber = firstFiber ; fiber <= lastFiber ; ++fiber)
+    {
+      G4TwoVector local = fFiberTable.GetPosition (fiber) - centre ;
+      positions.push_back (G4ThreeVector (local * u, local * v, 0.)) ;
+    }
+  
+  G4double radius = static_cast<const G4Tubs*> (cladLV->GetSolid ())->GetOuterRadius () ;
+  G4VSolid* envelopeS = new G4Box (Form ("%sBundle%d", name.c_str (), chamfer),
+                                   0.5 * (uMax - uMin) + radius, 0.5 * (vMax - vMin) + radius, 0.5*fiber_length) ;
+  G4LogicalVolume* envelopeLV = new G4LogicalVolume (envelopeS, motherLV->GetMaterial (), Form ("%sBundle%d", name.c_str (), chamfer)) ;
+  G4RotationMatrix rotation ;
+  rotation.rotateZ (u.phi ()) ;
+  new G4PVPlacement (G4Transform3D (rotation, G4ThreeVector (centre.x (), centre.y (), 0.)), envelopeLV,
+                     Form ("%sBundle%d", name.c_str (), chamfer), motherLV, false, chamfer, true) ;
+  envelopeLV->SetVisAttributes (G4VisAttributes::Invisible) ;
+  
+  FiberParameterisation* parameterisation = new FiberParameterisation (positions) ;
+  fFiberParameterisations.push_back (parameterisation) ;
+  G4VPhysicalVolume* cladPV    = new G4PVParameterised (Form ("%sClad%d", name.c_str (), chamfer), cladLV, envelopeLV, kUndefined, nFibers, parameterisation) ;
+  G4VPhysicalVolume* coreOutPV = new G4PVPlacement (0, G4ThreeVector (), coreOutLV, Form ("%sCoreOut%d", name.c_str (), chamfer), cladLV, false, 0, false) ;
+  G4VPhysicalVolume* coreInsPV = new G4PVPlacement (0, G4ThreeVector (), coreInsLV, Form ("%sCoreIns%d", name.c_str (), chamfer), coreOutLV, false, 0, false) ;
+  
+  fFiberTable.AddVolume (coreInsPV, FiberVolumeTable::kCoreIns, 2, firstFiber, nFibers) ;
+  fFiberTable.AddVolume (coreOutPV, FiberVolumeTable::kCoreOut, 1, firstFiber, nFibers) ;
+  fFiberTable.AddVolume (cladPV,    FiberVolumeTable::kClad,    0, firstFiber, nFibers) ;
+  fFiberCoreLV.push_back (coreInsLV) ;
+  fFiberCoreLV.push_back (coreOutLV) ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+/**
+Write the world just built, with its materials and their optical properties,
+unless the file is already there: a geometry file is not overwritten,
+so that it stays the one of its production.
+*/
+void DetectorConstruction::exportGDML (const G4VPhysicalVolume* worldPV) const
+{
+#ifdef G4LIB_USE_GDML
+  struct stat status ;
+  if (stat (gdml_export.c_str (), &status) == 0)
+    {
+      G4cout << ">>>>>> DetectorConstruction: " << gdml_export << " already exists, not exported again <<<<<<" << G4endl ;
+      return ;
+    }
+  G4GDMLParser parser ;
+  parser.Write (gdml_export, worldPV) ;
+  G4cout << ">>>>>> DetectorConstruction: geometry exported to " << gdml_export << " <<<<<<" << G4endl ;
+#else
+  G4cerr << "<DetectorConstruction::exportGDML>: built without GDML support, " << gdml_export << " not written" << G4endl ;
+#endif
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+namespace
+{
+  // the first volume with the given name below a logical volume, depth first
+  G4VPhysicalVolume* findVolume (const G4LogicalVolume* motherLV, const G4String& name)
+  {
+    for (G4int iDaughter = 0 ; iDaughter < motherLV->GetNoDaughters () ; ++iDaughter)
+      {
+        G4VPhysicalVolume* daughter = motherLV->GetDaughter (iDaughter) ;
+        if (daughter->GetName () == name) return daughter ;
+        if (daughter->IsParameterised ()) continue ;
+        G4VPhysicalVolume* found = findVolume (daughter->GetLogicalVolume (), name) ;
+        if (found) return found ;
+      }
+    return NULL ;
+  }
+}
+
+
+/**
+Read the world written by exportGDML, instead of building it and its materials.
+The volumes the simulation needs are found again by name: the crystal, and the
+bundles of fibers in the world, whose parameterised cladding gives the fiber positions
+and the volumes of the fiber table. The geometry and material parameters of the
+configuration are not used to build anything, they should be the ones of the file.
+*/
+G4VPhysicalVolume* DetectorConstruction::loadGDML ()
+{
+#ifdef G4LIB_USE_GDML
+  G4GDMLParser parser ;
+  parser.Read (gdml_load, false) ;
+  G4VPhysicalVolume* worldPV = parser.GetWorldVolume () ;
+  if (!worldPV)
+    {
+      G4cerr << "<DetectorConstruction::loadGDML>: no world in " << gdml_load << G4endl ;
+      return NULL ;
+    }
+  G4LogicalVolume* worldLV = worldPV->GetLogicalVolume () ;
+  
+  fCrystalPV  = findVolume (worldLV, "Crystal") ;
+  fAbsorberPV = findVolume (worldLV, "Absorber") ;
+  if (!fCrystalPV || !fAbsorberPV)
+    {
+      G4cerr << "<DetectorConstruction::loadGDML>: no crystal or absorber in " << gdml_load << G4endl ;
+      return NULL ;
+    }
+  const G4MaterialPropertiesTable* crystalProperties = fCrystalPV->GetLogicalVolume ()->GetMaterial ()->GetMaterialPropertiesTable () ;
+  if (!crystalProperties || !const_cast<G4MaterialPropertiesTable*> (crystalProperties)->ConstPropertyExists ("SCINTILLATIONYIELD"))
+    {
+      G4cerr << "<DetectorConstruction::loadGDML>: the crystal material of " << gdml_load << " has no scintillation properties" << G4endl ;
+      return NULL ;
+    }
+  
+  // the bundles, in the order of their chamfers
+  std::vector<std::pair<G4int, G4VPhysicalVolume*> > bundles ;
+  for (G4int iDaughter = 0 ; iDaughter < worldLV->GetNoDaughters () ; ++iDaughter)
+    {
+      G4VPhysicalVolume* daughter = worldLV->GetDaughter (iDaughter) ;
+      size_t position = daughter->GetName ().find ("Bundle") ;
+      if (position == std::string::npos) continue ;
+      bundles.push_back (std::make_pair (atoi (daughter->GetName ().substr (position + 6).c_str ()), daughter)) ;
+    }
+  std::sort (bundles.begin (), bundles.end ()) ;
+  
+  for (unsigned int iBundle = 0 ; iBundle < bundles.size () ; ++iBundle)
+    {
+      G4int chamfer = bundles.at (iBundle).first ;
+      G4VPhysicalVolume* envelopePV = bundles.at (iBundle).second ;
+      G4LogicalVolume* envelopeLV = envelopePV->GetLogicalVolume () ;
+      if (envelopeLV->GetNoDaughters () != 1 || !envelopeLV->GetDaughter (0)->IsParameterised ()) continue ;
+      G4VPhysicalVolume* cladPV = envelopeLV->GetDaughter (0) ;
+      G4VPhysicalVolume* coreOutPV = cladPV->GetLogicalVolume ()->GetDaughter (0) ;
+      G4VPhysicalVolume* coreInsPV = coreOutPV->GetLogicalVolume ()->GetDaughter (0) ;
+      
+      EAxis axis ;
+      G4int nFibers ;
+      G4double width, offset ;
+      G4bool consuming ;
+      cladPV->GetReplicationData (axis, nFibers, width, offset, consuming) ;
+      G4int firstFiber = fFiberTable.GetNFibers () ;
+      for (G4int iFiber = 0 ; iFiber < nFibers ; ++iFiber)
+        {
+          cladPV->GetParameterisation ()->ComputeTransformation (iFiber, cladPV) ;
+          G4ThreeVector position = envelopePV->GetObjectRotationValue () * cladPV->GetTranslation () + envelopePV->GetObjectTranslation () ;
+          fFiberTable.AddFiber (chamfer, G4TwoVector (position.x (), position.y ())) ;
+        }
+      
+      fFiberTable.AddVolume (coreInsPV, FiberVolumeTable::kCoreIns, 2, firstFiber, nFibers) ;
+      fFiberTable.AddVolume (coreOutPV, FiberVolumeTable::kCoreOut, 1, firstFiber, nFibers) ;
+      fFiberTable.AddVolume (cladPV,    FiberVolumeTable::kClad,    0, firstFiber, nFibers) ;
+      fFiberCoreLV.push_back (coreInsPV->GetLogicalVolume ()) ;
+      fFiberCoreLV.push_back (coreOutPV->GetLogicalVolume ()) ;
+    }
+  
+  G4cout << ">>>>>> DetectorConstruction: geometry loaded from " << gdml_load << " <<<<<<" << G4endl ;
+  return worldPV ;
+#else
+  G4cerr << "<DetectorConstruction::loadGDML>: built without GDML support, " << gdml_load << " cannot be read" << G4endl ;
+  return NULL ;
+#endif
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+std::vector<G4double> DetectorConstruction::materialParameters () const
+{
+  G4double parameters[] = { G4double (abs_material), G4double (crystal_material), 
+                            G4double (fiberCore_material), G4double (fiberClad_material) } ;
+  return std::vector<G4double> (parameters, parameters + sizeof (parameters) / sizeof (G4double)) ;
+}
+
+
+std::vector<G4double> DetectorConstruction::opticsParameters () const
+{
+  G4double parameters[] = { G4double (crystal_lightyield), crystal_risetime, crystal_abslength } ;
+  return std::vector<G4double> (parameters, parameters + sizeof (parameters) / sizeof (G4double)) ;
+}
+
+
+std::vector<G4double> DetectorConstruction::geometryParameters () const
+{
+  G4double parameters[] = { chamfer, module_xy, G4double (nLayers_z), abs_d, crystal_d, 
+                            fiberCore_radius, fiberClad_radius, depth } ;
+  return std::vector<G4double> (parameters, parameters + sizeof (parameters) / sizeof (G4double)) ;
+}
+
+
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void DetectorConstruction::initializeMaterials ()
@@ -482,8 +825,15 @@ void DetectorConstruction::initializeMaterials ()
   }
   G4cout << "Cl. material: "<< ClMaterial << G4endl ;
   
-  
-  
+  AirMaterial = MyMaterials::Air () ;
+}
+
+
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void DetectorConstruction::setScintillatorProperties ()
+{
   // modify default properties of the scintillator
   if ( crystal_lightyield >= 0 )
   {
@@ -517,176 +867,10 @@ void DetectorConstruction::initializeMaterials ()
 
 void DetectorConstruction::fillPolygon (std::vector<G4TwoVector>& theBase, const float& side, const float& chamfer)
 {
-  // wrt the centre (0, 0)
-  double delta = side - chamfer * 0.707106781188 ;
-  theBase.push_back (G4TwoVector (side, delta)) ;
-  theBase.push_back (G4TwoVector (delta, side)) ;
-  theBase.push_back (G4TwoVector (-1 * delta, side)) ;
-  theBase.push_back (G4TwoVector (-1 * side, delta)) ;
-  theBase.push_back (G4TwoVector (-1 * side, -1 * delta)) ;
-  theBase.push_back (G4TwoVector (-1 * delta, -1 * side)) ;
-  theBase.push_back (G4TwoVector (delta, -1 * side)) ;
-  theBase.push_back (G4TwoVector (side, -1 * delta)) ;
+  std::vector<G4TwoVector> octagon = FiberLayout::MakeOctagon (side, chamfer) ;
+  theBase.insert (theBase.end (), octagon.begin (), octagon.end ()) ;
   return ;
 }
 
 
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
-
-
-std::pair<G4TwoVector, G4TwoVector> DetectorConstruction::getChamfer (std::vector<G4TwoVector>& theBase, const int& index)
-{
-  return std::pair<G4TwoVector, G4TwoVector> (
-    theBase.at (2 * index), theBase.at (2*index + 1) ) ;
-}
-
-
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
-
-
-G4TwoVector DetectorConstruction::centerOfTheFirstFiber (std::pair<G4TwoVector, G4TwoVector>& theChamfer, const int& fibersNumberInRow, const float& fiberExternalRadius, const int& numberOfRadius)
-{
-  // assume that the chamfer coordinates are given counter-clockwise
-  // so the orthogonal vector aims towards the exterior of the chamfer
-  G4TwoVector chamferDirection = theChamfer.second - theChamfer.first ;
-  chamferDirection *= 1. / chamferDirection.mag () ; 
-  G4TwoVector chamferOrtogonal = chamferDirection ;
-  chamferOrtogonal.setX (chamferDirection.y ()) ;
-  chamferOrtogonal.setY (-1 * chamferDirection.x ()) ;
-  G4double freeSpace = (theChamfer.second-theChamfer.first).mag () - 2.*fiberExternalRadius - 2.*fiberExternalRadius*numberOfRadius - 2.*fiberExternalRadius* (fibersNumberInRow-2) ;
-  
-  return theChamfer.first +
-    fiberExternalRadius * numberOfRadius * chamferOrtogonal +  // go out for the length of the radius
-    fiberExternalRadius * numberOfRadius * chamferDirection +  // move towards the other edge for the space where fibers cannot fit
-    0.5 * freeSpace * chamferDirection ;                        // equally divide free space
-}
-
-
-
-
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
-
-
-G4TwoVector 
-DetectorConstruction::centerOfTheFirstFiberPG (
-    std::pair<G4TwoVector, G4TwoVector>&  theChamfer, 
-    const int&                           fibersNumberInRow, 
-    const float&                         fiberExternalRadius)
-{
-  // assume that the chamfer coordinates are given counter-clockwise
-  // so the orthogonal vector aims towards the exterior of the chamfer
-  G4TwoVector chamferDirection = theChamfer.second - theChamfer.first ;
-  chamferDirection *= 1. / chamferDirection.mag () ; 
-  G4TwoVector chamferOrtogonal = chamferDirection ;
-  chamferOrtogonal.setX (chamferDirection.y ()) ;
-  chamferOrtogonal.setY (-1 * chamferDirection.x ()) ;
-  G4double freeSpace = (theChamfer.second-theChamfer.first).mag () 
-                      - 2. * fiberExternalRadius * fibersNumberInRow ;
-  return theChamfer.first +                                        // the starting point
-         fiberExternalRadius * chamferOrtogonal +                  // go out for the length of the radius
-         (0.5 * freeSpace + fiberExternalRadius) * chamferDirection ;
-}
-
-
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
-
-
-G4TwoVector DetectorConstruction::getNextCenter (std::pair<G4TwoVector, G4TwoVector>& theChamfer, G4TwoVector& thisCenter, const float& fiberExternalRadius)
-{
-  G4TwoVector chamferDirection = theChamfer.second - theChamfer.first ;
-  chamferDirection *= 1. / chamferDirection.mag () ; 
-  return thisCenter + (2 * fiberExternalRadius) * chamferDirection ;
-}
-
-
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
-
-
-/**
-- check whether a fibre is out of the chamfer
-- does NOT check whether the fibre enters the crystal volume
-- assumes that the edges follow this notation in the solid front face:
-      6     5
-   7 /-----\ 4
-     |     |
-   0 \_____/ 3
-      1    2
-- the chamfer index goes as:      
-   3 /-----\ 2
-     |     |
-   0 \_____/ 1      
-*/
-bool 
-DetectorConstruction::checkIfOutOfChamfer (
-    double                    radius, 
-    G4TwoVector               centre, 
-    std::vector<G4TwoVector>  solid, 
-    int                       chamferIndex)
-{
-  // check wrt the side before the chamfer 
-  // -------------------------------------
-
-  //FIXME this is bugged I don't understand why  !!!
-  G4TwoVector vectorFromFirstEdgeOFChamfer = centre - solid.at (2 * chamferIndex) ;
-
-  int index = 2 * chamferIndex - 1 ;
-  if (index < 0) index += 8 ;
-
-  G4TwoVector sideDirection = solid.at (index) - solid.at (2 * chamferIndex) ;
-  sideDirection *= 1. / sideDirection.mag () ; 
-  G4TwoVector sideOrtogonal = sideDirection ;
-  sideOrtogonal.setX (sideDirection.y ()) ;
-  sideOrtogonal.setY (-1 * sideDirection.x ()) ;
-
-  float distance = sideOrtogonal.dot (vectorFromFirstEdgeOFChamfer) ;
-  if (distance < radius) return false ; 
-//  if (fabs (distance) < radius) return false ;
-
-  // check wrt the side after the chamfer 
-  // -------------------------------------
-
-  //FIXME this works    !!!!!
-
-  G4TwoVector vectorFromSecondEdgeOFChamfer = centre - solid.at (2 * chamferIndex + 1) ;
-
-  index = 2 * chamferIndex + 2 ;
-  if (index > 7) index -= 8 ;
-  sideDirection = solid.at (2 * chamferIndex + 1) - solid.at (index) ;
-  sideDirection *= 1. / sideDirection.mag () ; 
-  sideOrtogonal = sideDirection ;
-  sideOrtogonal.setX (sideDirection.y ()) ;
-  sideOrtogonal.setY (-1 * sideDirection.x ()) ;
-  
-  distance = sideOrtogonal.dot (vectorFromSecondEdgeOFChamfer) ;
-  // since the ortogonal aims outwards with respect to the crystal model, 
-  // the distance should be at least minus radius
-  if (distance < radius) return false ;
-
-  return true ;
-}
-
-
-//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
-
-
-G4TwoVector 
-DetectorConstruction::centerOfTheFirstFibreOnSecondLayer (
-    std::pair<G4TwoVector, G4TwoVector> &  theChamfer, 
-    const float &                          fiberExternalRadius, 
-    G4TwoVector                            previousLayerStart)
-{
-  // assume that the chamfer coordinates are given counter-clockwise
-  // so the orthogonal vector aims towards the exterior of the chamfer
-
-  G4TwoVector chamferDirection = theChamfer.second - theChamfer.first ;
-  chamferDirection *= 1. / chamferDirection.mag () ; 
-  G4TwoVector chamferOrtogonal = chamferDirection ;
-  chamferOrtogonal.setX (chamferDirection.y ()) ;
-  chamferOrtogonal.setY (-1 * chamferDirection.x ()) ;
-
-  return previousLayerStart                                            // the starting point
-         + fiberExternalRadius * chamferDirection                       
-         + (fiberExternalRadius * 1.73205080757) * chamferOrtogonal ; 
-}
-
 
@@ -13,6 +13,9 @@
 #include "MyMaterials.hh"
 #include "CreateTree.hh"
 #include "PrimaryGeneratorAction.hh"
+#include "ShashlikRunManager.hh"
+#include "EventSeeder.hh"
+#include "DetectorConstruction.hh"
 
 #include <vector>
 
@@ -47,8 +50,16 @@ void EventAction::BeginOfEventAction (const G4Event* evt)
   
   CreateTree::Instance ()->Clear () ;
   
+  // the geometry may change between runs
+  const DetectorConstruction* detector = 
+    (const DetectorConstruction*) G4RunManager::GetRunManager ()->GetUserDetectorConstruction () ;
+  CreateTree::Instance ()->SetLayers (detector->GetNLayers ()) ;
+  
   // INSTANCE RUN/EVENT IN TREE
-  CreateTree::Instance ()->Event = evt->GetEventID () ;
+  // the event number is global, also when the events are split among forked workers
+  CreateTree::Instance ()->Event = ShashlikRunManager::GetEventOffset () + evt->GetEventID () ;
+  CreateTree::Instance ()->Seed  = EventSeeder::EventSeed (CreateTree::Instance ()->Event, 0) ;
+  CreateTree::Instance ()->Seed2 = EventSeeder::EventSeed (CreateTree::Instance ()->Event, 1) ;
 }
 
 
@@ -0,0 +1,70 @@
+#include "EventSeeder.hh"
+
+#include "Randomize.hh"
+
+
+
+G4long EventSeeder::fMasterSeed = 0 ;
+
+
+namespace
+{
+  // splitmix64 finaliser, turns close inputs into uncorrelated outputs
+  unsigned long long mix (unsigned long long x)
+  {
+    x += 0x9E3779B97F4A7C15ULL ;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL ;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL ;
+    return x ^ (x >> 31) ;
+  }
+  
+  // seeds in [1, 2147483398], valid for both seeds of RanecuEngine
+  G4long toSeed (unsigned long long x)
+  {
+    return 1 + G4long (x % 2147483398ULL) ;
+  }
+  
+  // 64 bits state of an event, from which its seeds are derived
+  unsigned long long eventState (G4long masterSeed, G4long eventNumber)
+  {
+    return mix (mix ((unsigned long long) masterSeed) ^ (unsigned long long) eventNumber) ;
+  }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Non-negative, so that it is never taken for the -1 of a configuration without seed.
+*/
+G4long EventSeeder::DerivedSeed (G4long masterSeed, G4long index)
+{
+  return G4long (eventState (masterSeed, index) >> 1) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4long EventSeeder::EventSeed (G4long eventNumber, G4int index)
+{
+  unsigned long long state = eventState (fMasterSeed, eventNumber) ;
+  return toSeed (mix (index == 0 ? state : state ^ 0xD6E8FEB86659FD93ULL)) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The two seeds are reduced separately from two independent mixes of the event state,
+so that the RanecuEngine installed by the main program has about 2^62 different
+streams: two events of a job sharing one are not to be expected.
+The list is zero-terminated as expected by the engines with a variable number of seeds.
+*/
+void EventSeeder::SeedEvent (G4long eventNumber)
+{
+  long seeds[3] = { EventSeed (eventNumber, 0), EventSeed (eventNumber, 1), 0 } ;
+  CLHEP::HepRandom::setTheSeeds (seeds) ;
+}
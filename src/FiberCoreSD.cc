@@ -0,0 +1,82 @@
+#include "FiberCoreSD.hh"
+#include "FiberVolumeTable.hh"
+#include "CreateTree.hh"
+#include "LightCollectionTable.hh"
+#include "DetectorConstruction.hh"
+
+#include "G4RunManager.hh"
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4VProcess.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4SystemOfUnits.hh"
+
+
+
+FiberCoreSD::FiberCoreSD (const G4String& name, const FiberVolumeTable* fiberTable) :
+  G4VSensitiveDetector (name),
+  fFiberTable (fiberTable)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+FiberCoreSD::~FiberCoreSD ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The per fiber sums only grow when the geometry gets more fibers,
+they are reset by CreateTree::Clear at the beginning of the event.
+*/
+void FiberCoreSD::Initialize (G4HCofThisEvent*)
+{
+  CreateTree::Instance ()->ReserveFibers (fFiberTable->GetNFibers ()) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The step starts in a core, it is counted if it also ends in a core.
+This includes both the inner and outer unphysical sub-volumes of the core.
+*/
+G4bool FiberCoreSD::ProcessHits (G4Step* step, G4TouchableHistory*)
+{
+  G4Track* track = step->GetTrack () ;
+  if (track->GetDefinition () != G4OpticalPhoton::OpticalPhotonDefinition ()) return false ;
+  
+  G4int preFiber, postFiber ;
+  if (!fFiberTable->IsCore (step->GetPreStepPoint ()->GetTouchable (), preFiber)) return false ;
+  if (!fFiberTable->IsCore (step->GetPostStepPoint ()->GetTouchable (), postFiber)) return false ;
+  
+  // the chamfer where the photon is traveling in
+  int chamfer = fFiberTable->GetChamfer (preFiber) ;
+  G4float length = step->GetStepLength () ;
+  G4float weight = track->GetWeight () ;
+  
+  // give the length to the chamfer
+  CreateTree::Instance ()->totalPhLengthInChamfer[chamfer] += weight * length/mm ;
+  
+  // sum the lengths for each photon and for each fiber separately
+  if (CreateTree::Instance ()->addPhoton (track->GetTrackID (), length/mm, chamfer, preFiber, weight))
+    {
+      // calibration of the light collection table: a scintillation photon from a crystal reached this chamfer
+      LightCollectionTable* lightTable = LightCollectionTable::Instance () ;
+      if (lightTable && lightTable->GetMode () == LightCollectionTable::kCalibration &&
+          track->GetCreatorProcess () && track->GetCreatorProcess ()->GetProcessName () == "Scintillation")
+        {
+          const DetectorConstruction* detector = 
+            (const DetectorConstruction*) G4RunManager::GetRunManager ()->GetUserDetectorConstruction () ;
+          if (track->GetLogicalVolumeAtVertex () == detector->GetCrystalPV ()->GetLogicalVolume ())
+            lightTable->Collect (track->GetVertexPosition (), chamfer) ;
+        }
+    }
+  
+  return true ;
+}
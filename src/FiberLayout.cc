@@ -0,0 +1,260 @@
+#include "FiberLayout.hh"
+
+#include <cmath>
+
+
+
+FiberLayout::FiberLayout (const std::vector<G4TwoVector>& octagon) :
+  fOctagon (octagon)
+{
+  for (G4int iChamfer = 0 ; iChamfer < kNChamfers ; ++iChamfer)
+    {
+      fPolicies[iChamfer] = kEmpty ;
+      fRadii[iChamfer] = 0. ;
+    }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The vertices and the chamfers are numbered as, on the front face:
+      6     5
+   7 /-----\ 4              3 /-----\ 2
+     |     |                  |     |
+   0 \_____/ 3                0 \_____/ 1
+      1    2
+*/
+std::vector<G4TwoVector> FiberLayout::MakeOctagon (G4double halfSide, G4double chamfer)
+{
+  // wrt the centre (0, 0)
+  G4double delta = halfSide - chamfer * 0.707106781188 ;
+  std::vector<G4TwoVector> octagon ;
+  octagon.push_back (G4TwoVector (halfSide, delta)) ;
+  octagon.push_back (G4TwoVector (delta, halfSide)) ;
+  octagon.push_back (G4TwoVector (-1 * delta, halfSide)) ;
+  octagon.push_back (G4TwoVector (-1 * halfSide, delta)) ;
+  octagon.push_back (G4TwoVector (-1 * halfSide, -1 * delta)) ;
+  octagon.push_back (G4TwoVector (-1 * delta, -1 * halfSide)) ;
+  octagon.push_back (G4TwoVector (delta, -1 * halfSide)) ;
+  octagon.push_back (G4TwoVector (halfSide, -1 * delta)) ;
+  return octagon ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void FiberLayout::SetPolicy (G4int chamfer, Policy policy, G4double radius)
+{
+  fPolicies[chamfer] = policy ;
+  fRadii[chamfer] = radius ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The radius of the large fiber is 0.95 sqrt(3)/8 of the chamfer,
+which keeps it within the corner of the square out of the chamfer.
+*/
+void FiberLayout::SetDefaultPolicies (G4double fiberRadius)
+{
+  SetPolicy (0, kRows, fiberRadius) ;
+  SetPolicy (1, kSingleRow, fiberRadius) ;
+  SetPolicy (2, kHexagonal, fiberRadius) ;
+  SetPolicy (3, kSingleLarge, MakeFrame (3).length * 1.73205080757 * 0.125 * 0.95) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4TwoVector FiberLayout::GetDirection (G4int chamfer) const
+{
+  return MakeFrame (chamfer).direction ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The array is reserved for the densest packing of the corners out of the chamfers,
+so that it is not reallocated while filling.
+*/
+const std::vector<FiberLayout::Fiber>& FiberLayout::Compute ()
+{
+  fFibers.clear () ;
+  
+  size_t capacity = 0 ;
+  for (G4int iChamfer = 0 ; iChamfer < kNChamfers ; ++iChamfer)
+    {
+      if (fPolicies[iChamfer] == kEmpty || fRadii[iChamfer] <= 0.) continue ;
+      G4double length = MakeFrame (iChamfer).length ;
+      capacity += size_t (0.25 * length * length / (fRadii[iChamfer] * fRadii[iChamfer])) + 1 ;
+    }
+  fFibers.reserve (capacity) ;
+  
+  for (G4int iChamfer = 0 ; iChamfer < kNChamfers ; ++iChamfer)
+    {
+      if (fRadii[iChamfer] <= 0.) continue ;
+      Frame frame = MakeFrame (iChamfer) ;
+      switch (fPolicies[iChamfer])
+        {
+          case kRows        : FillRows (frame, fRadii[iChamfer]) ; break ;
+          case kSingleRow   : FillSingleRow (frame, fRadii[iChamfer]) ; break ;
+          case kHexagonal   : FillHexagonal (frame, fRadii[iChamfer]) ; break ;
+          case kSingleLarge : FillSingleLarge (frame, fRadii[iChamfer]) ; break ;
+          default : break ;
+        }
+    }
+  return fFibers ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The vertices are counter-clockwise, so the orthogonal vector aims towards the exterior of the chamfer.
+*/
+FiberLayout::Frame FiberLayout::MakeFrame (G4int chamfer) const
+{
+  Frame frame ;
+  frame.chamfer = chamfer ;
+  frame.first  = fOctagon.at (2 * chamfer) ;
+  frame.second = fOctagon.at (2 * chamfer + 1) ;
+  frame.length = (frame.second - frame.first).mag () ;
+  frame.direction = (frame.second - frame.first) / frame.length ;
+  frame.outward = G4TwoVector (frame.direction.y (), -1 * frame.direction.x ()) ;
+  return frame ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void FiberLayout::Add (const Frame& frame, const G4TwoVector& position, G4double radius)
+{
+  Fiber fiber = { position.x (), position.y (), radius, frame.chamfer, 0 } ;
+  fFibers.push_back (fiber) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The row at an odd number of radii out of the chamfer keeps the same number of radii
+free at its ends, for the corner, and shares the rest of the free space between them.
+*/
+void FiberLayout::FillRows (const Frame& frame, G4double radius)
+{
+  for (G4int numberOfRadius = 1 ; ; numberOfRadius += 2)
+    {
+      G4int fibersInRow = G4int (std::floor ((frame.length - 2. * numberOfRadius * radius) / (2. * radius))) ;
+      if (fibersInRow <= 0) break ;
+      
+      G4double freeSpace = frame.length - 2. * radius - 2. * radius * numberOfRadius - 2. * radius * (fibersInRow - 2) ;
+      G4TwoVector position = frame.first 
+                           + radius * numberOfRadius * frame.outward               // go out for the length of the radii
+                           + radius * numberOfRadius * frame.direction             // the space where fibers cannot fit
+                           + 0.5 * freeSpace * frame.direction ;                   // equally divide the free space
+      for (G4int i = 0 ; i < fibersInRow ; ++i)
+        {
+          if (i > 0) position += (2. * radius) * frame.direction ;
+          Add (frame, position, radius) ;
+        }
+    }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void FiberLayout::FillSingleRow (const Frame& frame, G4double radius)
+{
+  G4int fibersInRow = G4int (std::floor ((frame.length - 2. * radius) / (2. * radius))) ;
+  G4double freeSpace = frame.length - 4. * radius - 2. * radius * (fibersInRow - 2) ;
+  G4TwoVector position = frame.first + radius * frame.outward + (radius + 0.5 * freeSpace) * frame.direction ;
+  for (G4int i = 0 ; i < fibersInRow ; ++i)
+    {
+      if (i > 0) position += (2. * radius) * frame.direction ;
+      Add (frame, position, radius) ;
+    }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The first row lies on the chamfer, each following one is shifted by one radius along
+the chamfer and sqrt(3) radii out of it, the fibers crossing the sides next to the chamfer
+are left out. At most 20 rows are added after the first one, up to half the chamfer out of it.
+*/
+void FiberLayout::FillHexagonal (const Frame& frame, G4double radius)
+{
+  G4int fibersInRow = G4int (std::floor ((frame.length - 2. * radius * 1.41421356237) / (2. * radius))) ;
+  if (fibersInRow <= 0) return ;
+  
+  G4double freeSpace = frame.length - 2. * radius * fibersInRow ;
+  G4TwoVector rowStart = frame.first + radius * frame.outward + (0.5 * freeSpace + radius) * frame.direction ;
+  G4TwoVector position = rowStart ;
+  for (G4int i = 0 ; i < fibersInRow ; ++i)
+    {
+      if (i > 0) position += (2. * radius) * frame.direction ;
+      Add (frame, position, radius) ;
+    }
+  
+  G4TwoVector rowShift = radius * frame.direction + (radius * 1.73205080757) * frame.outward ;
+  for (G4int row = 1 ; row <= 20 ; ++row)
+    {
+      rowStart += rowShift ;
+      if (frame.outward.dot (rowStart - frame.second) > 0.5 * frame.length) break ;
+      
+      position = rowStart ;
+      for (G4int i = 0 ; i < fibersInRow ; ++i)
+        {
+          if (i > 0) position += (2. * radius) * frame.direction ;
+          if (IsWithinSides (frame, position, radius)) Add (frame, position, radius) ;
+        }
+    }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void FiberLayout::FillSingleLarge (const Frame& frame, G4double radius)
+{
+  Add (frame, frame.first + 0.5 * frame.length * frame.direction + radius * frame.outward, radius) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Each side is measured along its normal, taken on the same side as the outward
+vector of the chamfer; it does not check whether the fiber enters the crystal.
+*/
+G4bool FiberLayout::IsWithinSides (const Frame& frame, const G4TwoVector& centre, G4double radius) const
+{
+  G4int nVertices = fOctagon.size () ;
+  
+  // the side before the chamfer
+  G4int index = (2 * frame.chamfer - 1 + nVertices) % nVertices ;
+  G4TwoVector side = (fOctagon.at (index) - frame.first).unit () ;
+  if (G4TwoVector (side.y (), -1 * side.x ()).dot (centre - frame.first) < radius) return false ;
+  
+  // the side after the chamfer
+  index = (2 * frame.chamfer + 2) % nVertices ;
+  side = (frame.second - fOctagon.at (index)).unit () ;
+  if (G4TwoVector (side.y (), -1 * side.x ()).dot (centre - frame.second) < radius) return false ;
+  
+  return true ;
+}
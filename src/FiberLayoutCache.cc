@@ -0,0 +1,215 @@
+#include "FiberLayoutCache.hh"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+
+namespace
+{
+  const char   kMagic[8] = { 'S', 'H', 'F', 'I', 'B', 'L', 'A', 'Y' } ;
+  const G4int  kVersion = 1 ;
+  
+  // 64 bits FNV-1a hash, enough to name the layout files
+  unsigned long long hash (const std::string& text)
+  {
+    unsigned long long h = 0xCBF29CE484222325ULL ;
+    for (unsigned int i = 0 ; i < text.size () ; ++i)
+      {
+        h ^= (unsigned char) text[i] ;
+        h *= 0x100000001B3ULL ;
+      }
+    return h ;
+  }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+FiberLayoutCache::FiberLayoutCache (const std::string& cacheDir, G4double module_xy, G4double chamfer,
+                                    G4double cladRadius, G4double coreRadius) :
+  fCacheDir (cacheDir),
+  fModule_xy (module_xy),
+  fChamfer (chamfer),
+  fCladRadius (cladRadius),
+  fCoreRadius (coreRadius),
+  fMapping (NULL),
+  fMappingSize (0),
+  fNFibers (0),
+  fFibers (NULL)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+FiberLayoutCache::~FiberLayoutCache ()
+{
+  Unmap () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+std::string FiberLayoutCache::GetFileName () const
+{
+  std::ostringstream key ;
+  key.precision (10) ;
+  key << "version " << kVersion << " module_xy " << fModule_xy << " chamfer " << fChamfer 
+      << " clad " << fCladRadius << " core " << fCoreRadius ;
+  char name[48] ;
+  sprintf (name, "/layout_%016llx.bin", hash (key.str ())) ;
+  return fCacheDir + name ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool FiberLayoutCache::Map ()
+{
+  if (!IsEnabled ()) return false ;
+  
+  std::string fileName = GetFileName () ;
+  if (!MapFile (fileName)) 
+    {
+      G4cout << ">>> FiberLayoutCache: no layout in " << fileName << ", it will be computed <<<" << G4endl ;
+      return false ;
+    }
+  
+  const Header* header = static_cast<const Header*> (fMapping) ;
+  if (header->module_xy != fModule_xy || header->chamfer != fChamfer || 
+      header->cladRadius != fCladRadius || header->coreRadius != fCoreRadius)
+    {
+      G4cout << ">>> FiberLayoutCache: the layout in " << fileName << " does not match, it will be computed <<<" << G4endl ;
+      Unmap () ;
+      return false ;
+    }
+  
+  G4cout << ">>> FiberLayoutCache: " << fNFibers << " fibers mapped from " << fileName << " <<<" << G4endl ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The file is checked to be a layout file of this version, written on a machine
+with the same sizes of the records, and to hold all of its fibers.
+*/
+G4bool FiberLayoutCache::MapFile (const std::string& fileName)
+{
+  Unmap () ;
+  if (sizeof (Header) != 48 || sizeof (FiberLayout::Fiber) != 32) return false ;
+  
+  int file = open (fileName.c_str (), O_RDONLY) ;
+  if (file < 0) return false ;
+  struct stat status ;
+  if (fstat (file, &status) != 0 || size_t (status.st_size) < sizeof (Header))
+    {
+      close (file) ;
+      return false ;
+    }
+  
+  void* mapping = mmap (NULL, status.st_size, PROT_READ, MAP_SHARED, file, 0) ;
+  close (file) ;
+  if (mapping == MAP_FAILED)
+    {
+      G4cerr << "<FiberLayoutCache::MapFile>: cannot map " << fileName << ": " << strerror (errno) << G4endl ;
+      return false ;
+    }
+  fMapping = mapping ;
+  fMappingSize = status.st_size ;
+  
+  const Header* header = static_cast<const Header*> (fMapping) ;
+  if (memcmp (header->magic, kMagic, sizeof (kMagic)) != 0 || header->version != kVersion || header->nFibers < 0 ||
+      fMappingSize != sizeof (Header) + header->nFibers * sizeof (FiberLayout::Fiber))
+    {
+      G4cerr << "<FiberLayoutCache::MapFile>: " << fileName << " is not a valid layout file" << G4endl ;
+      Unmap () ;
+      return false ;
+    }
+  
+  fNFibers = header->nFibers ;
+  fFibers = reinterpret_cast<const FiberLayout::Fiber*> (static_cast<const char*> (fMapping) + sizeof (Header)) ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The file is written under a name of this process and then moved in place,
+so that concurrent jobs never map an incomplete layout.
+*/
+G4bool FiberLayoutCache::Store (const std::vector<FiberLayout::Fiber>& fibers) const
+{
+  if (!IsEnabled ()) return false ;
+  
+  std::string fileName = GetFileName () ;
+  std::ostringstream tmpName ;
+  tmpName << fileName << ".tmp" << getpid () ;
+  
+  mkdir (fCacheDir.c_str (), 0755) ;
+  FILE* file = fopen (tmpName.str ().c_str (), "wb") ;
+  if (!file)
+    {
+      G4cerr << "<FiberLayoutCache::Store>: cannot create " << tmpName.str () << ": " << strerror (errno) << G4endl ;
+      return false ;
+    }
+  
+  Header header ;
+  MakeHeader (header, fibers.size ()) ;
+  G4bool ok = (fwrite (&header, sizeof (Header), 1, file) == 1) ;
+  if (ok && !fibers.empty ()) ok = (fwrite (&fibers[0], sizeof (FiberLayout::Fiber), fibers.size (), file) == fibers.size ()) ;
+  ok = (fclose (file) == 0) && ok ;
+  
+  if (!ok || rename (tmpName.str ().c_str (), fileName.c_str ()) != 0)
+    {
+      G4cerr << "<FiberLayoutCache::Store>: cannot write " << fileName << G4endl ;
+      unlink (tmpName.str ().c_str ()) ;
+      return false ;
+    }
+  
+  G4cout << ">>> FiberLayoutCache: " << fibers.size () << " fibers stored in " << fileName << " <<<" << G4endl ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void FiberLayoutCache::MakeHeader (Header& header, G4int nFibers) const
+{
+  memset (&header, 0, sizeof (Header)) ;
+  memcpy (header.magic, kMagic, sizeof (kMagic)) ;
+  header.version    = kVersion ;
+  header.nFibers    = nFibers ;
+  header.module_xy  = fModule_xy ;
+  header.chamfer    = fChamfer ;
+  header.cladRadius = fCladRadius ;
+  header.coreRadius = fCoreRadius ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void FiberLayoutCache::Unmap ()
+{
+  if (fMapping) munmap (fMapping, fMappingSize) ;
+  fMapping = NULL ;
+  fMappingSize = 0 ;
+  fNFibers = 0 ;
+  fFibers = NULL ;
+}
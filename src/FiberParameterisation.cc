@@ -0,0 +1,26 @@
+#include "FiberParameterisation.hh"
+
+#include "G4VPhysicalVolume.hh"
+
+
+
+FiberParameterisation::FiberParameterisation (const std::vector<G4ThreeVector>& positions) :
+  fPositions (positions)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+FiberParameterisation::~FiberParameterisation ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void FiberParameterisation::ComputeTransformation (const G4int copyNo, G4VPhysicalVolume* physVol) const
+{
+  physVol->SetTranslation (fPositions[copyNo]) ;
+  physVol->SetRotation (0) ;
+}
@@ -0,0 +1,152 @@
+#include "FiberTransportModel.hh"
+#include "FiberVolumeTable.hh"
+#include "CreateTree.hh"
+
+#include <algorithm>
+#include <cmath>
+
+#include "G4FastTrack.hh"
+#include "G4FastStep.hh"
+#include "G4Track.hh"
+#include "G4Step.hh"
+#include "G4Tubs.hh"
+#include "G4Material.hh"
+#include "G4MaterialPropertiesTable.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4EventManager.hh"
+#include "G4Event.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+
+
+FiberTransportModel::FiberTransportModel (const G4String& name, G4Region* envelope,
+                                          const FiberVolumeTable* fiberTable, G4bool validation) :
+  G4VFastSimulationModel (name, envelope),
+  fFiberTable (fiberTable),
+  fValidation (validation),
+  fLastEvent (-1),
+  fLastTrack (-1)
+{
+  G4cout << ">>> FiberTransportModel: analytic photon transport in the fiber cores"
+         << (fValidation ? ", validation mode: full tracking, predictions written next to it" : "") << " <<<" << G4endl ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+FiberTransportModel::~FiberTransportModel ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool FiberTransportModel::IsApplicable (const G4ParticleDefinition& particle)
+{
+  return &particle == G4OpticalPhoton::OpticalPhotonDefinition () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The decision is taken when the photon enters a core volume or is created in it,
+at the other steps inside the core it is left to the tracking.
+*/
+G4bool FiberTransportModel::ModelTrigger (const G4FastTrack& fastTrack)
+{
+  const G4Track* track = fastTrack.GetPrimaryTrack () ;
+  if (track->GetCurrentStepNumber () > 1 &&
+      track->GetStep ()->GetPreStepPoint ()->GetStepStatus () != fGeomBoundary) return false ;
+  
+  if (!ComputeTransport (fastTrack, fTransport)) return false ;
+  if (!fValidation) return true ;
+  
+  // each photon predicted once, the first time it enters a core
+  G4int event = G4EventManager::GetEventManager ()->GetConstCurrentEvent ()->GetEventID () ;
+  if (event == fLastEvent && track->GetTrackID () == fLastTrack) return false ;
+  fLastEvent = event ;
+  fLastTrack = track->GetTrackID () ;
+  
+  int chamfer = fFiberTable->GetChamfer (fTransport.fiber) ;
+  CreateTree::Instance ()->fastPhLengthInChamfer[chamfer] += track->GetWeight () * fTransport.length / mm ;
+  CreateTree::Instance ()->numFastPhotonsInChamfer[chamfer] += 1 ;
+  return false ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The step of the photon keeps its null length, so that the FiberCoreSD
+does not count its path a second time.
+*/
+void FiberTransportModel::DoIt (const G4FastTrack& fastTrack, G4FastStep& fastStep)
+{
+  const G4Track* track = fastTrack.GetPrimaryTrack () ;
+  int chamfer = fFiberTable->GetChamfer (fTransport.fiber) ;
+  CreateTree::Instance ()->totalPhLengthInChamfer[chamfer] += track->GetWeight () * fTransport.length / mm ;
+  CreateTree::Instance ()->addPhoton (track->GetTrackID (), fTransport.length / mm,
+                                      chamfer, fTransport.fiber, track->GetWeight ()) ;
+  
+  fastStep.ProposePrimaryTrackFinalTime (fTransport.time) ;
+  fastStep.KillPrimaryTrack () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The photon is trapped if its angle to the fiber axis is within the one
+allowed by total internal reflection at the core-cladding surface,
+cos (theta) > n_clad / n_core, as for a meridional ray: the skew rays
+trapped at larger angles and the cladding modes are left to the tracking.
+The fibers are straight along z in the local frame of the core.
+*/
+G4bool FiberTransportModel::ComputeTransport (const G4FastTrack& fastTrack, Transport& transport) const
+{
+  const G4VPhysicalVolume* volume = fastTrack.GetEnvelopePhysicalVolume () ;
+  if (!fFiberTable->IsCore (fastTrack.GetPrimaryTrack ()->GetTouchable (), transport.fiber)) return false ;
+  const G4Tubs* core = dynamic_cast<const G4Tubs*> (fastTrack.GetEnvelopeSolid ()) ;
+  if (!core) return false ;
+  
+  const G4Track* track = fastTrack.GetPrimaryTrack () ;
+  G4double energy = track->GetTotalEnergy () ;
+  const G4VPhysicalVolume* clad = fFiberTable->GetVolume (transport.fiber, FiberVolumeTable::kClad) ;
+  G4double nCore = GetProperty (volume->GetLogicalVolume ()->GetMaterial (), "RINDEX", energy) ;
+  G4double nClad = GetProperty (clad->GetLogicalVolume ()->GetMaterial (), "RINDEX", energy) ;
+  if (nCore <= 0. || nClad <= 0. || nClad >= nCore) return false ;
+  
+  const G4ThreeVector& direction = fastTrack.GetPrimaryTrackLocalDirection () ;
+  G4double cosTheta = std::fabs (direction.z ()) ;
+  if (cosTheta < nClad / nCore) return false ;
+  
+  // path to the fiber end ahead, cut by the absorption in the core
+  G4double z = fastTrack.GetPrimaryTrackLocalPosition ().z () ;
+  G4double toEnd = core->GetZHalfLength () - (direction.z () > 0. ? z : -z) ;
+  transport.length = std::max (0., toEnd) / cosTheta ;
+  G4double absLength = GetProperty (volume->GetLogicalVolume ()->GetMaterial (), "ABSLENGTH", energy) ;
+  if (absLength > 0.) transport.length = std::min (transport.length, -absLength * std::log (G4UniformRand ())) ;
+  
+  transport.time = track->GetGlobalTime () + transport.length * nCore / c_light ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4double FiberTransportModel::GetProperty (const G4Material* material, const char* key, G4double energy)
+{
+  G4MaterialPropertiesTable* table = material->GetMaterialPropertiesTable () ;
+  if (!table) return -1. ;
+  G4MaterialPropertyVector* property = table->GetProperty (key) ;
+  if (!property) return -1. ;
+  return property->Value (energy) ;
+}
@@ -0,0 +1,276 @@
+#include "FiberVolumeTable.hh"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+namespace
+{
+  // upper limit of the cells of a grid along each axis
+  const G4int kMaxCells = 4096 ;
+  
+  // squared distance of a point from a box, 0 inside
+  G4double distance2ToBox (const G4TwoVector& point, G4double minX, G4double minY, G4double maxX, G4double maxY)
+  {
+    G4double dx = std::max (0., std::max (minX - point.x (), point.x () - maxX)) ;
+    G4double dy = std::max (0., std::max (minY - point.y (), point.y () - maxY)) ;
+    return dx * dx + dy * dy ;
+  }
+  
+  // slab test of a ray against a box, in the transverse plane
+  G4bool rayHitsBox (const G4TwoVector& point, const G4TwoVector& direction, const G4TwoVector& min, const G4TwoVector& max)
+  {
+    G4double tMin = 0. ;
+    G4double tMax = DBL_MAX ;
+    for (int axis = 0 ; axis < 2 ; ++axis)
+      {
+        G4double p = axis == 0 ? point.x () : point.y () ;
+        G4double d = axis == 0 ? direction.x () : direction.y () ;
+        G4double low  = axis == 0 ? min.x () : min.y () ;
+        G4double high = axis == 0 ? max.x () : max.y () ;
+        if (std::fabs (d) < 1.e-12)
+          {
+            if (p < low || p > high) return false ;
+            continue ;
+          }
+        G4double t1 = (low - p) / d ;
+        G4double t2 = (high - p) / d ;
+        tMin = std::max (tMin, std::min (t1, t2)) ;
+        tMax = std::min (tMax, std::max (t1, t2)) ;
+        if (tMin > tMax) return false ;
+      }
+    return true ;
+  }
+}
+
+
+
+G4int FiberVolumeTable::AddFiber (G4int chamfer, const G4TwoVector& position)
+{
+  if (fChamfers.empty () || fFibers.back ().chamfer != chamfer)
+    {
+      Chamfer range = { G4int (fFibers.size ()), G4int (fFibers.size ()), position, position, 0., 0, 0, 0 } ;
+      fChamfers.push_back (range) ;
+    }
+  // the grids are built again once all the fibers are there
+  fCellStart.clear () ;
+  fCellFibers.clear () ;
+  Chamfer& range = fChamfers.back () ;
+  range.last = fFibers.size () ;
+  range.min.set (std::min (range.min.x (), position.x ()), std::min (range.min.y (), position.y ())) ;
+  range.max.set (std::max (range.max.x (), position.x ()), std::max (range.max.y (), position.y ())) ;
+  
+  Fiber fiber ;
+  fiber.chamfer = chamfer ;
+  fiber.indexInChamfer = range.last - range.first ;
+  fiber.position = position ;
+  fFibers.push_back (fiber) ;
+  return fFibers.size () - 1 ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The cores go before the claddings, as they are the volumes looked for most often.
+*/
+void FiberVolumeTable::AddVolume (const G4VPhysicalVolume* volume, Part part, G4int depth, G4int firstFiber, G4int nFibers)
+{
+  Volume entry = { volume, part, depth, firstFiber, nFibers } ;
+  if (part == kClad) fVolumes.push_back (entry) ;
+  else
+    {
+      std::vector<Volume>::iterator firstClad = fVolumes.begin () ;
+      while (firstClad != fVolumes.end () && firstClad->part != kClad) ++firstClad ;
+      fVolumes.insert (firstClad, entry) ;
+    }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+const G4VPhysicalVolume* FiberVolumeTable::GetVolume (G4int fiber, Part part) const
+{
+  for (unsigned int iVolume = 0 ; iVolume < fVolumes.size () ; ++iVolume)
+    {
+      const Volume& entry = fVolumes[iVolume] ;
+      if (entry.part == part && fiber >= entry.firstFiber && fiber < entry.firstFiber + entry.nFibers) return entry.volume ;
+    }
+  return NULL ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The cells hold about two fibers each; a chamfer whose fibers are on a line
+gets cells as long as the line divided by half the number of fibers.
+*/
+void FiberVolumeTable::BuildSearchGrid ()
+{
+  std::vector<G4int> cellOfFiber (fFibers.size (), 0) ;
+  std::vector<G4int> count ;
+  for (unsigned int iChamfer = 0 ; iChamfer < fChamfers.size () ; ++iChamfer)
+    {
+      Chamfer& range = fChamfers[iChamfer] ;
+      G4int nFibers = range.last - range.first + 1 ;
+      G4double width  = range.max.x () - range.min.x () ;
+      G4double height = range.max.y () - range.min.y () ;
+      range.cell = std::sqrt (2. * width * height / nFibers) ;
+      if (range.cell <= 0.) range.cell = 2. * std::max (width, height) / nFibers ;
+      if (range.cell <= 0.) range.cell = 1. ;
+      range.nx = std::min (G4int (width / range.cell) + 1, kMaxCells) ;
+      range.ny = std::min (G4int (height / range.cell) + 1, kMaxCells) ;
+      range.firstCell = count.size () ;
+      count.resize (count.size () + range.nx * range.ny, 0) ;
+      
+      for (G4int iFiber = range.first ; iFiber <= range.last ; ++iFiber)
+        {
+          const G4TwoVector& position = fFibers[iFiber].position ;
+          cellOfFiber[iFiber] = range.firstCell + CellY (range, position.y ()) * range.nx + CellX (range, position.x ()) ;
+          ++count[cellOfFiber[iFiber]] ;
+        }
+    }
+  
+  fCellStart.assign (count.size () + 1, 0) ;
+  for (unsigned int iCell = 0 ; iCell < count.size () ; ++iCell)
+    fCellStart[iCell + 1] = fCellStart[iCell] + count[iCell] ;
+  fCellFibers.resize (fFibers.size ()) ;
+  std::vector<G4int> next (fCellStart.begin (), fCellStart.end () - 1) ;
+  for (unsigned int iFiber = 0 ; iFiber < fFibers.size () ; ++iFiber)
+    fCellFibers[next[cellOfFiber[iFiber]]++] = iFiber ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4int FiberVolumeTable::CellX (const Chamfer& range, G4double x) const
+{
+  return std::max (0, std::min (range.nx - 1, G4int (std::floor ((x - range.min.x ()) / range.cell)))) ;
+}
+
+
+G4int FiberVolumeTable::CellY (const Chamfer& range, G4double y) const
+{
+  return std::max (0, std::min (range.ny - 1, G4int (std::floor ((y - range.min.y ()) / range.cell)))) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The cells are visited in square rings around the one of the point, clamped to the grid,
+until the cells not visited yet are all farther than the nearest fiber found:
+they lie beyond one of the sides of the square that are inside the grid.
+*/
+void FiberVolumeTable::SearchGrid (const Chamfer& range, const G4TwoVector& point, G4int& nearest, G4double& nearest2) const
+{
+  G4int cx = CellX (range, point.x ()) ;
+  G4int cy = CellY (range, point.y ()) ;
+  for (G4int ring = 0 ; ; ++ring)
+    {
+      G4int x0 = cx - ring, x1 = cx + ring ;
+      G4int y0 = cy - ring, y1 = cy + ring ;
+      for (G4int iy = std::max (y0, 0) ; iy <= std::min (y1, range.ny - 1) ; ++iy)
+        {
+          G4bool fullRow = (iy == y0 || iy == y1) ;
+          G4int step = fullRow ? 1 : 2 * ring ;
+          for (G4int ix = fullRow ? std::max (x0, 0) : x0 ; ix <= std::min (x1, range.nx - 1) ; ix += step)
+            {
+              if (ix < 0) continue ;
+              G4int cell = range.firstCell + iy * range.nx + ix ;
+              for (G4int iEntry = fCellStart[cell] ; iEntry < fCellStart[cell + 1] ; ++iEntry)
+                {
+                  G4int iFiber = fCellFibers[iEntry] ;
+                  G4double distance2 = (fFibers[iFiber].position - point).mag2 () ;
+                  if (distance2 < nearest2 || (distance2 == nearest2 && iFiber < nearest))
+                    {
+                      nearest2 = distance2 ;
+                      nearest = iFiber ;
+                    }
+                }
+            }
+        }
+      
+      // the cells not visited yet are in the strips of the grid beyond the sides of the square
+      G4double gridMaxX = range.min.x () + range.nx * range.cell ;
+      G4double gridMaxY = range.min.y () + range.ny * range.cell ;
+      G4double bound2 = DBL_MAX ;
+      if (x0 > 0)            bound2 = std::min (bound2, distance2ToBox (point, range.min.x (), range.min.y (), range.min.x () + x0 * range.cell, gridMaxY)) ;
+      if (x1 < range.nx - 1) bound2 = std::min (bound2, distance2ToBox (point, range.min.x () + (x1 + 1) * range.cell, range.min.y (), gridMaxX, gridMaxY)) ;
+      if (y0 > 0)            bound2 = std::min (bound2, distance2ToBox (point, range.min.x (), range.min.y (), gridMaxX, range.min.y () + y0 * range.cell)) ;
+      if (y1 < range.ny - 1) bound2 = std::min (bound2, distance2ToBox (point, range.min.x (), range.min.y () + (y1 + 1) * range.cell, gridMaxX, gridMaxY)) ;
+      if (bound2 >= nearest2) return ;
+    }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The fibers of a chamfer are looked at only if the bounding box
+of the chamfer is closer than the nearest fiber found so far,
+through the search grid once it is built.
+*/
+G4int FiberVolumeTable::FindNearestFiber (const G4TwoVector& point, G4double& distance) const
+{
+  G4int nearest = -1 ;
+  G4double nearest2 = DBL_MAX ;
+  for (unsigned int iChamfer = 0 ; iChamfer < fChamfers.size () ; ++iChamfer)
+    {
+      const Chamfer& range = fChamfers[iChamfer] ;
+      G4double dx = std::max (0., std::max (range.min.x () - point.x (), point.x () - range.max.x ())) ;
+      G4double dy = std::max (0., std::max (range.min.y () - point.y (), point.y () - range.max.y ())) ;
+      if (dx * dx + dy * dy >= nearest2) continue ;
+      
+      if (!fCellStart.empty ())
+        {
+          SearchGrid (range, point, nearest, nearest2) ;
+          continue ;
+        }
+      for (G4int iFiber = range.first ; iFiber <= range.last ; ++iFiber)
+        {
+          G4double distance2 = (fFibers[iFiber].position - point).mag2 () ;
+          if (distance2 < nearest2)
+            {
+              nearest2 = distance2 ;
+              nearest = iFiber ;
+            }
+        }
+    }
+  distance = (nearest < 0) ? DBL_MAX : std::sqrt (nearest2) ;
+  return nearest ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The largest cosine with the directions to the points of a box is 1 if the ray
+crosses the box, otherwise the one of the direction to one of its corners.
+*/
+G4bool FiberVolumeTable::IsHeadingToFibers (const G4TwoVector& point, const G4TwoVector& direction, G4double minCos) const
+{
+  for (unsigned int iChamfer = 0 ; iChamfer < fChamfers.size () ; ++iChamfer)
+    {
+      const Chamfer& range = fChamfers[iChamfer] ;
+      if (rayHitsBox (point, direction, range.min, range.max)) return true ;
+      
+      G4TwoVector corners[4] = { range.min, G4TwoVector (range.max.x (), range.min.y ()),
+                                 range.max, G4TwoVector (range.min.x (), range.max.y ()) } ;
+      for (int iCorner = 0 ; iCorner < 4 ; ++iCorner)
+        {
+          G4TwoVector toCorner = corners[iCorner] - point ;
+          if (direction.dot (toCorner) >= minCos * toCorner.mag ()) return true ;
+        }
+    }
+  return false ;
+}
@@ -52,18 +52,35 @@
 #include "G4SystemOfUnits.hh"
 
 #include "G4Cerenkov.hh"
-#include "G4Scintillation.hh"
+#include "LayerScintillation.hh"
 #include "G4OpAbsorption.hh"
 #include "G4OpRayleigh.hh"
 #include "G4OpMieHG.hh"
 #include "G4OpBoundaryProcess.hh"
+#include "G4FastSimulationManagerProcess.hh"
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 G4EmUserPhysics::G4EmUserPhysics(G4int ver)
+  : G4VPhysicsConstructor("User Optical Options"), verbose(ver), scintFraction(1.),
+    firstOpticalLayer(0), lastOpticalLayer(-1), opticalFibers(true), useFastSimulation(false), useLimiter(false)
+{
+  G4LossTableManager::Instance();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4EmUserPhysics::G4EmUserPhysics(G4int ver, const ConfigFile& config)
   : G4VPhysicsConstructor("User Optical Options"), verbose(ver)
 {
   G4LossTableManager::Instance();
+  scintFraction = config.read<double>("scint_fraction", 1.);
+  if( scintFraction <= 0. || scintFraction > 1. ) scintFraction = 1.;
+  firstOpticalLayer = config.read<int>("optical_firstLayer", 0);
+  lastOpticalLayer = config.read<int>("optical_lastLayer", -1);
+  opticalFibers = config.read<bool>("optical_fibers", true);
+  useFastSimulation = (config.read<int>("fiberFastSim", 0) > 0);
+  useLimiter = OpticalPhotonLimiter::ReadLimits(config, limiterLimits);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -83,7 +100,7 @@ void G4EmUserPhysics::ConstructParticle()
 void G4EmUserPhysics::ConstructProcess()
 {
   theCerenkovProcess = new G4Cerenkov("Cerenkov");
-  theScintillationProcess = new G4Scintillation("Scintillation");
+  theScintillationProcess = new LayerScintillation("Scintillation", firstOpticalLayer, lastOpticalLayer, opticalFibers);
   theAbsorptionProcess = new G4OpAbsorption();
   theRayleighScatteringProcess = new G4OpRayleigh();
   theMieHGScatteringProcess = new G4OpMieHG();
@@ -97,7 +114,8 @@ void G4EmUserPhysics::ConstructProcess()
   theCerenkovProcess->SetMaxBetaChangePerStep(10.0);
   theCerenkovProcess->SetTrackSecondariesFirst(true);
   
-  theScintillationProcess->SetScintillationYieldFactor(1.);
+  // thinning: the photons generated carry the weight 1/scintFraction, see StackingAction
+  theScintillationProcess->SetScintillationYieldFactor(scintFraction);
   theScintillationProcess->SetTrackSecondariesFirst(true);
   
   // Use Birks Correction in the Scintillation process
@@ -133,6 +151,14 @@ void G4EmUserPhysics::ConstructProcess()
       pmanager->AddDiscreteProcess(theRayleighScatteringProcess);
       pmanager->AddDiscreteProcess(theMieHGScatteringProcess);
       pmanager->AddDiscreteProcess(theBoundaryProcess);
+
+      // the fiber transport model of the FiberCores region
+      if (useFastSimulation)
+        pmanager->AddDiscreteProcess(new G4FastSimulationManagerProcess("fastSimProcess"));
+
+      // without limits there is no need to pay for a forced process at every step
+      if (useLimiter)
+        pmanager->AddDiscreteProcess(new OpticalPhotonLimiter(limiterLimits));
     }
   }
 }
@@ -0,0 +1,76 @@
+#include "LayerScintillation.hh"
+#include "DetectorConstruction.hh"
+#include "FiberVolumeTable.hh"
+#include "CreateTree.hh"
+
+#include "G4RunManager.hh"
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4SystemOfUnits.hh"
+
+
+
+LayerScintillation::LayerScintillation (const G4String& name, G4int firstLayer, G4int lastLayer, G4bool fibers) :
+  G4Scintillation (name),
+  fFirstLayer (firstLayer),
+  fLastLayer (lastLayer),
+  fFibers (fibers)
+{
+  fDetector = (const DetectorConstruction*) G4RunManager::GetRunManager ()->GetUserDetectorConstruction () ;
+  
+  G4cout << ">>> LayerScintillation: optical photons generated in the layers " << fFirstLayer << " to " ;
+  if (fLastLayer < 0) G4cout << "the last" ;
+  else                G4cout << fLastLayer ;
+  G4cout << (fFibers ? ", and in the fibers" : ", not in the fibers") << " <<<" << G4endl ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+LayerScintillation::~LayerScintillation ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The scintillation process runs at every step of the charged particles,
+which is where the deposit of the layer is recorded.
+The steps of the other volumes (absorber, air) produce no light anyway.
+*/
+G4VParticleChange* LayerScintillation::PostStepDoIt (const G4Track& track, const G4Step& step)
+{
+  const G4StepPoint* point = step.GetPreStepPoint () ;
+  G4int layer = fDetector->GetCrystalLayer (point->GetPhysicalVolume (), point->GetTouchable ()) ;
+  
+  G4bool generate = true ;
+  if (layer >= 0)
+    {
+      CreateTree::Instance ()->AddLayerDeposit (layer, step.GetTotalEnergyDeposit () / MeV) ;
+      generate = (layer >= fFirstLayer && (fLastLayer < 0 || layer <= fLastLayer)) ;
+    }
+  else if (!fFibers)
+    {
+      G4int fiber ;
+      generate = (fDetector->GetFiberTable ()->GetPart (point->GetTouchable (), fiber) == FiberVolumeTable::kNone) ;
+    }
+  
+  if (generate) return G4Scintillation::PostStepDoIt (track, step) ;
+  aParticleChange.Initialize (track) ;
+  return &aParticleChange ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+G4Scintillation::AtRestDoIt calls its own PostStepDoIt,
+the selection has to be applied here too.
+*/
+G4VParticleChange* LayerScintillation::AtRestDoIt (const G4Track& track, const G4Step& step)
+{
+  return PostStepDoIt (track, step) ;
+}
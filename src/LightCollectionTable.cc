@@ -0,0 +1,258 @@
+#include "LightCollectionTable.hh"
+
+#include <cmath>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef G4MULTITHREADED
+#include "G4Threading.hh"
+#endif
+
+
+
+G4ThreadLocal LightCollectionTable* LightCollectionTable::fInstance = NULL ;
+G4ThreadLocal G4int LightCollectionTable::fNSaved = 0 ;
+
+
+namespace
+{
+  // 64 bits FNV-1a hash, enough to name the table directories
+  unsigned long long hash (const std::string& text)
+  {
+    unsigned long long h = 0xCBF29CE484222325ULL ;
+    for (unsigned int i = 0 ; i < text.size () ; ++i)
+      {
+        h ^= (unsigned char) text[i] ;
+        h *= 0x100000001B3ULL ;
+      }
+    return h ;
+  }
+  
+  // create a directory and the missing ones above it
+  void makeDirs (const std::string& path)
+  {
+    for (std::string::size_type slash = path.find ('/', 1) ; slash != std::string::npos ; slash = path.find ('/', slash + 1))
+      mkdir (path.substr (0, slash).c_str (), 0755) ;
+    mkdir (path.c_str (), 0755) ;
+  }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+LightCollectionTable::LightCollectionTable (Mode mode, const std::string& cacheDir, const std::string& key,
+                                            const std::vector<int>& bins, const G4ThreeVector& size, G4double zFront) :
+  fMode (mode),
+  fSize (size),
+  fZFront (zFront)
+{
+  for (int i = 0 ; i < 3 ; ++i) fBins[i] = (i < int (bins.size ()) && bins.at (i) > 0) ? bins.at (i) : 1 ;
+  for (int i = 0 ; i < kNChamfers ; ++i) fNone[i] = 0. ;
+  
+  std::ostringstream fullKey ;
+  fullKey << key << "bins " << fBins[0] << " " << fBins[1] << " " << fBins[2] << "\n" ;
+  fKey = fullKey.str () ;
+  char name[32] ;
+  sprintf (name, "%016llx", hash (fKey)) ;
+  fTableDir = cacheDir + "/" + name ;
+  
+  fEmitted.assign (fBins[0] * fBins[1] * fBins[2], 0.) ;
+  fCollected.assign (fEmitted.size () * kNChamfers, 0.) ;
+  
+  G4cout << ">>> LightCollectionTable: " << (fMode == kCalibration ? "calibration" : "fast") << " mode, "
+         << fBins[0] << "x" << fBins[1] << "x" << fBins[2] << " bins in " << fTableDir << " <<<" << G4endl ;
+  
+  delete fInstance ;
+  fInstance = this ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+LightCollectionTable::~LightCollectionTable ()
+{
+  if (fInstance == this) fInstance = NULL ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4int LightCollectionTable::Bin (const G4ThreeVector& position) const
+{
+  G4int ix = G4int (std::floor ((position.x () / fSize.x () + 0.5) * fBins[0])) ;
+  G4int iy = G4int (std::floor ((position.y () / fSize.y () + 0.5) * fBins[1])) ;
+  G4double zInLayer = std::fmod (position.z () - fZFront, fSize.z ()) ;
+  if (zInLayer < 0.) zInLayer += fSize.z () ;
+  G4int iz = G4int (zInLayer / fSize.z () * fBins[2]) ;
+  if (ix < 0 || ix >= fBins[0] || iy < 0 || iy >= fBins[1] || iz < 0 || iz >= fBins[2]) return -1 ;
+  return (ix * fBins[1] + iy) * fBins[2] + iz ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void LightCollectionTable::Emit (const G4ThreeVector& emission)
+{
+  G4int bin = Bin (emission) ;
+  if (bin >= 0) fEmitted[bin] += 1. ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void LightCollectionTable::Collect (const G4ThreeVector& emission, G4int chamfer)
+{
+  G4int bin = Bin (emission) ;
+  if (bin >= 0 && chamfer >= 0 && chamfer < kNChamfers) fCollected[bin * kNChamfers + chamfer] += 1. ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Each call writes a file of its own, named after the host, process, thread and time,
+written under a temporary name and then renamed, so that Load () never sees
+incomplete counts. Only the bins with emitted photons are written,
+and no file at all for the runs without any, such as the BeamOn (0)
+that builds the physics tables.
+*/
+G4bool LightCollectionTable::Save ()
+{
+  G4double nEmitted = 0. ;
+  for (unsigned int bin = 0 ; bin < fEmitted.size () ; ++bin)
+    nEmitted += fEmitted[bin] ;
+  if (nEmitted <= 0.) return true ;
+  
+  makeDirs (fTableDir) ;
+  
+  std::string keyName = fTableDir + "/key.txt" ;
+  if (access (keyName.c_str (), F_OK) != 0)
+    {
+      std::ofstream keyFile (keyName.c_str ()) ;
+      keyFile << fKey ;
+    }
+  
+  char host[64] = "" ;
+  gethostname (host, sizeof (host) - 1) ;
+  int thread = 0 ;
+#ifdef G4MULTITHREADED
+  thread = G4Threading::G4GetThreadId () ;
+#endif
+  std::ostringstream fileName ;
+  fileName << fTableDir << "/counts_" << host << "_" << getpid () << "_" << thread << "_" << fNSaved++ << "_" << time (NULL) << ".txt" ;
+  std::string tmpName = fileName.str () + ".tmp" ;
+  
+  std::ofstream file (tmpName.c_str ()) ;
+  if (!file)
+    {
+      G4cerr << "<LightCollectionTable::Save>: cannot write " << tmpName << ": " << strerror (errno) << G4endl ;
+      return false ;
+    }
+  file << "bins " << fBins[0] << " " << fBins[1] << " " << fBins[2] << "\n" ;
+  for (unsigned int bin = 0 ; bin < fEmitted.size () ; ++bin)
+    {
+      if (fEmitted[bin] <= 0.) continue ;
+      file << bin << " " << fEmitted[bin] ;
+      for (int chamfer = 0 ; chamfer < kNChamfers ; ++chamfer) file << " " << fCollected[bin * kNChamfers + chamfer] ;
+      file << "\n" ;
+    }
+  file.close () ;
+  if (!file || rename (tmpName.c_str (), fileName.str ().c_str ()) != 0)
+    {
+      G4cerr << "<LightCollectionTable::Save>: cannot write " << fileName.str () << ": " << strerror (errno) << G4endl ;
+      remove (tmpName.c_str ()) ;
+      return false ;
+    }
+  
+  G4cout << ">>> LightCollectionTable: " << nEmitted << " photons written to " << fileName.str () << " <<<" << G4endl ;
+  fEmitted.assign (fEmitted.size (), 0.) ;
+  fCollected.assign (fCollected.size (), 0.) ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool LightCollectionTable::Load ()
+{
+  fProbability.clear () ;
+  
+  std::ifstream keyFile ((fTableDir + "/key.txt").c_str ()) ;
+  std::stringstream storedKey ;
+  if (keyFile) storedKey << keyFile.rdbuf () ;
+  if (storedKey.str () != fKey)
+    {
+      G4cerr << "<LightCollectionTable::Load>: no table for this detector in " << fTableDir
+             << ", run the calibration first" << G4endl ;
+      return false ;
+    }
+  
+  std::vector<G4double> emitted (fEmitted.size (), 0.) ;
+  std::vector<G4double> collected (fCollected.size (), 0.) ;
+  int nFiles = 0 ;
+  DIR* dir = opendir (fTableDir.c_str ()) ;
+  struct dirent* entry ;
+  while (dir && (entry = readdir (dir)) != NULL)
+    {
+      std::string name = entry->d_name ;
+      if (name.compare (0, 7, "counts_") != 0 || name.rfind (".txt") != name.size () - 4) continue ;
+      std::ifstream file ((fTableDir + "/" + name).c_str ()) ;
+      std::string word ;
+      int bins[3] ;
+      file >> word >> bins[0] >> bins[1] >> bins[2] ;
+      if (word != "bins" || bins[0] != fBins[0] || bins[1] != fBins[1] || bins[2] != fBins[2]) continue ;
+      unsigned int bin ;
+      G4double counts[kNChamfers + 1] ;
+      while (file >> bin)
+        {
+          for (int i = 0 ; i <= kNChamfers ; ++i) file >> counts[i] ;
+          if (!file || bin >= emitted.size ()) break ;
+          emitted[bin] += counts[0] ;
+          for (int chamfer = 0 ; chamfer < kNChamfers ; ++chamfer) collected[bin * kNChamfers + chamfer] += counts[chamfer + 1] ;
+        }
+      ++nFiles ;
+    }
+  if (dir) closedir (dir) ;
+  if (nFiles == 0)
+    {
+      G4cerr << "<LightCollectionTable::Load>: no counts in " << fTableDir << ", run the calibration first" << G4endl ;
+      return false ;
+    }
+  
+  G4double nEmitted = 0. ;
+  fProbability.assign (fCollected.size (), 0.) ;
+  for (unsigned int bin = 0 ; bin < emitted.size () ; ++bin)
+    {
+      nEmitted += emitted[bin] ;
+      if (emitted[bin] <= 0.) continue ;
+      for (int chamfer = 0 ; chamfer < kNChamfers ; ++chamfer)
+        fProbability[bin * kNChamfers + chamfer] = collected[bin * kNChamfers + chamfer] / emitted[bin] ;
+    }
+  G4cout << ">>> LightCollectionTable: " << nEmitted << " calibration photons from " << nFiles << " files loaded <<<" << G4endl ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+const G4double* LightCollectionTable::GetProbabilities (const G4ThreeVector& emission) const
+{
+  G4int bin = Bin (emission) ;
+  if (bin < 0 || fProbability.empty ()) return fNone ;
+  return &fProbability[bin * kNChamfers] ;
+}
@@ -0,0 +1,122 @@
+#include "OpticalPhotonLimiter.hh"
+#include "DetectorConstruction.hh"
+#include "FiberVolumeTable.hh"
+#include "CreateTree.hh"
+
+#include <algorithm>
+
+#include "G4RunManager.hh"
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4SystemOfUnits.hh"
+
+
+
+static const char* regionNames[OpticalPhotonLimiter::kNRegions] = { "crystal", "fiber", "other" } ;
+
+
+G4bool OpticalPhotonLimiter::ReadLimits (const ConfigFile& config, Limits limits[kNRegions])
+{
+  G4bool any = false ;
+  for (int iRegion = 0 ; iRegion < kNRegions ; ++iRegion)
+    {
+      std::string region = regionNames[iRegion] ;
+      limits[iRegion].maxTime   = std::max (0., config.read<double> ("optical_maxTime_" + region, -1.)) * ns ;
+      limits[iRegion].maxLength = std::max (0., config.read<double> ("optical_maxLength_" + region, -1.)) * mm ;
+      limits[iRegion].maxSteps  = std::max (0, config.read<int> ("optical_maxSteps_" + region, -1)) ;
+      if (limits[iRegion].maxTime > 0. || limits[iRegion].maxLength > 0. || limits[iRegion].maxSteps > 0)
+        any = true ;
+    }
+  return any ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+OpticalPhotonLimiter::OpticalPhotonLimiter (const Limits limits[kNRegions], const G4String& name) :
+  G4VDiscreteProcess (name, fGeneral)
+{
+  fDetector = (const DetectorConstruction*) G4RunManager::GetRunManager ()->GetUserDetectorConstruction () ;
+  for (int iRegion = 0 ; iRegion < kNRegions ; ++iRegion)
+    {
+      fLimits[iRegion] = limits[iRegion] ;
+      G4cout << ">>> OpticalPhotonLimiter: " << regionNames[iRegion] << " max time " << fLimits[iRegion].maxTime / ns
+             << " ns, max length " << fLimits[iRegion].maxLength / mm
+             << " mm, max steps " << fLimits[iRegion].maxSteps << " (0: off) <<<" << G4endl ;
+    }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+OpticalPhotonLimiter::~OpticalPhotonLimiter ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool OpticalPhotonLimiter::IsApplicable (const G4ParticleDefinition& particle)
+{
+  return &particle == G4OpticalPhoton::OpticalPhotonDefinition () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The process never limits the step, it is forced to run at the end of every
+step, whatever process limited it, to check the track against the limits.
+*/
+G4double OpticalPhotonLimiter::PostStepGetPhysicalInteractionLength (const G4Track&, G4double,
+                                                                     G4ForceCondition* condition)
+{
+  *condition = StronglyForced ;
+  return DBL_MAX ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The limits applied are the ones of the region of the step that just ended.
+The time is checked first, then the length, then the number of steps:
+the first one exceeded is the one counted.
+*/
+G4VParticleChange* OpticalPhotonLimiter::PostStepDoIt (const G4Track& track, const G4Step& step)
+{
+  aParticleChange.Initialize (track) ;
+  // forced also after another process, e.g. OpAbsorption, killed the photon in the step
+  if (track.GetTrackStatus () == fStopAndKill) return &aParticleChange ;
+  
+  const Limits& limits = fLimits[GetRegion (step.GetPreStepPoint ())] ;
+  
+  int reason = -1 ;
+  if      (limits.maxTime > 0.   && track.GetGlobalTime () > limits.maxTime)           reason = kTime ;
+  else if (limits.maxLength > 0. && track.GetTrackLength () > limits.maxLength)        reason = kLength ;
+  else if (limits.maxSteps > 0   && track.GetCurrentStepNumber () > limits.maxSteps)   reason = kSteps ;
+  if (reason < 0) return &aParticleChange ;
+  
+  aParticleChange.ProposeTrackStatus (fStopAndKill) ;
+  CreateTree::Instance ()->numPhotonsKilled[reason] += 1 ;
+  return &aParticleChange ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+OpticalPhotonLimiter::Region OpticalPhotonLimiter::GetRegion (const G4StepPoint* point) const
+{
+  const G4VPhysicalVolume* volume = point->GetPhysicalVolume () ;
+  if (!volume) return kOther ;
+  if (volume == fDetector->GetCrystalPV ()) return kCrystal ;
+  G4int fiber ;
+  if (fDetector->GetFiberTable ()->GetPart (point->GetTouchable (), fiber) != FiberVolumeTable::kNone) return kFiber ;
+  return kOther ;
+}
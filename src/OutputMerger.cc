@@ -0,0 +1,330 @@
+#include "OutputMerger.hh"
+#include "CreateTree.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "TFile.h"
+#include "TTree.h"
+#include "TKey.h"
+#include "TFileMerger.h"
+
+
+
+OutputMerger::OutputMerger (const TString& treeName) :
+  fTreeName (treeName),
+  fNProcesses (sysconf (_SC_NPROCESSORS_ONLN)),
+  fRenumber (false),
+  fRemoveInputs (false),
+  fCompression (1),
+  fSameCompression (true),
+  fOrdered (true)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+OutputMerger::~OutputMerger ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+bool OutputMerger::Merge (const TString& outputName)
+{
+  std::cout << ">>> OutputMerger: merging " << fInputs.size () << " files into " << outputName << " <<<" << std::endl ;
+  if (!CheckInputs ()) return false ;
+  
+  bool success = false ;
+  if (fRenumber && !fOrdered) success = SortedCopy (outputName) ;
+  else
+    {
+      success = ParallelConcatenate (outputName) ;
+      if (success && !fOrdered) success = BuildIndex (outputName) ;
+    }
+  if (success) success = CheckOutput (outputName) ;
+  
+  if (!success)
+    {
+      std::cerr << "<OutputMerger::Merge>: merging into " << outputName << " failed, the inputs are kept" << std::endl ;
+      remove (outputName.Data ()) ;
+      return false ;
+    }
+  
+  if (fRemoveInputs)
+    {
+      for (unsigned int iInput = 0 ; iInput < fInputs.size () ; ++iInput)
+        remove (fInputs.at (iInput).Data ()) ;
+    }
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Read the event range and the compression settings of each input.
+Only the Event branch is read.
+*/
+bool OutputMerger::CheckInputs ()
+{
+  fEntries.clear () ;
+  fFirstEvent.clear () ;
+  fLastEvent.clear () ;
+  fSameCompression = true ;
+  fOrdered = true ;
+  
+  int lastEvent = -1 ;
+  for (unsigned int iInput = 0 ; iInput < fInputs.size () ; ++iInput)
+    {
+      TFile* file = TFile::Open (fInputs.at (iInput)) ;
+      if (!file || file->IsZombie ())
+        {
+          std::cerr << "<OutputMerger::CheckInputs>: cannot open " << fInputs.at (iInput) << std::endl ;
+          delete file ;
+          return false ;
+        }
+      TTree* tree = (TTree*) file->Get (fTreeName) ;
+      if (!tree)
+        {
+          std::cerr << "<OutputMerger::CheckInputs>: no tree " << fTreeName << " in " << fInputs.at (iInput) << std::endl ;
+          delete file ;
+          return false ;
+        }
+      
+      if (iInput == 0) fCompression = file->GetCompressionSettings () ;
+      else if (file->GetCompressionSettings () != fCompression) fSameCompression = false ;
+      
+      fEntries.push_back (tree->GetEntries ()) ;
+      fFirstEvent.push_back (tree->GetEntries () > 0 ? int (tree->GetMinimum ("Event")) : 0) ;
+      fLastEvent.push_back  (tree->GetEntries () > 0 ? int (tree->GetMaximum ("Event")) : -1) ;
+      if (tree->GetEntries () > 0)
+        {
+          if (fFirstEvent.back () <= lastEvent) fOrdered = false ;
+          lastEvent = fLastEvent.back () ;
+        }
+      
+      delete file ;
+    }
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+bool OutputMerger::Concatenate (const std::vector<TString>& inputs, const TString& outputName) const
+{
+  TFileMerger merger (kFALSE) ;
+  merger.SetPrintLevel (0) ;
+  // baskets are copied as they are only if there is no need to recompress them
+  merger.SetFastMethod (fSameCompression) ;
+  if (!merger.OutputFile (outputName, kTRUE, fCompression)) return false ;
+  for (unsigned int iInput = 0 ; iInput < inputs.size () ; ++iInput)
+    if (!merger.AddFile (inputs.at (iInput), kFALSE)) return false ;
+  return merger.Merge () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The inputs are split in contiguous groups, each merged by a forked process,
+then the groups are concatenated in order.
+*/
+bool OutputMerger::ParallelConcatenate (const TString& outputName) const
+{
+  int nGroups = std::min (fNProcesses, int (fInputs.size ()) / 2) ;
+  if (nGroups <= 1) return Concatenate (fInputs, outputName) ;
+  
+  std::vector<TString> groupNames ;
+  std::vector<pid_t> pids ;
+  int groupSize = (fInputs.size () + nGroups - 1) / nGroups ;
+  for (unsigned int first = 0 ; first < fInputs.size () ; first += groupSize)
+    {
+      unsigned int last = std::min (first + groupSize, (unsigned int) fInputs.size ()) ;
+      std::vector<TString> group (fInputs.begin () + first, fInputs.begin () + last) ;
+      TString groupName = outputName ;
+      groupName.ReplaceAll (".root", "") ;
+      groupName += Form ("_group%d.root", int (groupNames.size ())) ;
+      groupNames.push_back (groupName) ;
+      
+      fflush (stdout) ;
+      pid_t pid = fork () ;
+      if (pid == 0) _exit (Concatenate (group, groupName) ? 0 : 1) ;
+      pids.push_back (pid) ;
+    }
+  
+  bool success = true ;
+  for (unsigned int iGroup = 0 ; iGroup < pids.size () ; ++iGroup)
+    {
+      int status = 0 ;
+      if (pids.at (iGroup) < 0 || waitpid (pids.at (iGroup), &status, 0) < 0 || 
+          !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        success = false ;
+    }
+  
+  if (success) success = Concatenate (groupNames, outputName) ;
+  for (unsigned int iGroup = 0 ; iGroup < groupNames.size () ; ++iGroup)
+    remove (groupNames.at (iGroup).Data ()) ;
+  return success ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Only the Event branch is read, the index is written next to the tree
+without touching its baskets.
+*/
+bool OutputMerger::BuildIndex (const TString& outputName) const
+{
+  TFile* output = TFile::Open (outputName, "UPDATE") ;
+  TTree* tree = (output && !output->IsZombie ()) ? (TTree*) output->Get (fTreeName) : NULL ;
+  bool success = tree && tree->BuildIndex ("Event") >= 0 && 
+                 tree->Write ("", TObject::kOverwrite) > 0 && !output->TestBit (TFile::kWriteError) ;
+  if (!success) std::cerr << "<OutputMerger::BuildIndex>: cannot index " << fTreeName << " in " << outputName << std::endl ;
+  delete output ;
+  return success ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The output has to hold all the entries of the inputs before they can be removed.
+*/
+bool OutputMerger::CheckOutput (const TString& outputName) const
+{
+  Long64_t expected = 0 ;
+  for (unsigned int iInput = 0 ; iInput < fEntries.size () ; ++iInput)
+    expected += fEntries.at (iInput) ;
+  
+  TFile* output = TFile::Open (outputName) ;
+  TTree* tree = (output && !output->IsZombie ()) ? (TTree*) output->Get (fTreeName) : NULL ;
+  Long64_t entries = tree ? tree->GetEntries () : -1 ;
+  delete output ;
+  if (entries != expected)
+    {
+      std::cerr << "<OutputMerger::CheckOutput>: " << outputName << " holds " << entries 
+                << " entries instead of " << expected << std::endl ;
+      return false ;
+    }
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The entries are read through a CreateTree attached to each input in turn,
+and filled in the output in increasing event number.
+The other objects of the first input (if any) are copied as they are.
+Any failure to read or write stops the copy.
+*/
+bool OutputMerger::SortedCopy (const TString& outputName) const
+{
+  bool success = true ;
+  std::vector<TFile*> files ;
+  std::vector<TTree*> trees ;
+  for (unsigned int iInput = 0 ; iInput < fInputs.size () && success ; ++iInput)
+    {
+      files.push_back (TFile::Open (fInputs.at (iInput))) ;
+      trees.push_back ((files.back () && !files.back ()->IsZombie ()) ? (TTree*) files.back ()->Get (fTreeName) : NULL) ;
+      if (!trees.back ())
+        {
+          std::cerr << "<OutputMerger::SortedCopy>: cannot read " << fTreeName << " from " << fInputs.at (iInput) << std::endl ;
+          success = false ;
+        }
+    }
+  
+  // the event number shift of each input
+  std::vector<int> offsets (fInputs.size (), 0) ;
+  if (fRenumber)
+    {
+      for (unsigned int iInput = 1 ; iInput < fInputs.size () ; ++iInput)
+        offsets.at (iInput) = offsets.at (iInput-1) + fLastEvent.at (iInput-1) + 1 ;
+    }
+  
+  // (event number, (input, entry))
+  std::vector<std::pair<int, std::pair<int, Long64_t> > > rows ;
+  for (unsigned int iInput = 0 ; iInput < trees.size () && success ; ++iInput)
+    {
+      int event = 0 ;
+      trees.at (iInput)->SetBranchStatus ("*", 0) ;
+      trees.at (iInput)->SetBranchStatus ("Event", 1) ;
+      trees.at (iInput)->SetBranchAddress ("Event", &event) ;
+      for (Long64_t iEntry = 0 ; iEntry < fEntries.at (iInput) && success ; ++iEntry)
+        {
+          if (trees.at (iInput)->GetEntry (iEntry) <= 0) success = false ;
+          rows.push_back (std::make_pair (event + offsets.at (iInput), std::make_pair (iInput, iEntry))) ;
+        }
+      trees.at (iInput)->ResetBranchAddresses () ;
+      trees.at (iInput)->SetBranchStatus ("*", 1) ;
+    }
+  std::stable_sort (rows.begin (), rows.end ()) ;
+  
+  TFile* output = success ? new TFile (outputName, "RECREATE", "", fCompression) : NULL ;
+  if (output && output->IsZombie ())
+    {
+      std::cerr << "<OutputMerger::SortedCopy>: cannot create " << outputName << std::endl ;
+      success = false ;
+    }
+  CreateTree* buffer = new CreateTree (fTreeName, false) ;
+  if (success)
+    {
+      buffer->GetTree ()->SetDirectory (output) ;
+      for (unsigned int iInput = 0 ; iInput < trees.size () ; ++iInput)
+        buffer->Attach (trees.at (iInput)) ;
+    }
+  
+  for (unsigned int iRow = 0 ; iRow < rows.size () && success ; ++iRow)
+    {
+      if (trees.at (rows.at (iRow).second.first)->GetEntry (rows.at (iRow).second.second) <= 0) success = false ;
+      buffer->Event = rows.at (iRow).first ;
+      if (buffer->GetTree ()->Fill () < 0) success = false ;
+    }
+  if (success)
+    {
+      output->cd () ;
+      if (buffer->GetTree ()->Write () <= 0) success = false ;
+    }
+  
+  if (success && files.size () > 0)
+    {
+      std::set<TString> copied ;
+      TIter nextKey (files.at (0)->GetListOfKeys ()) ;
+      while (TKey* key = (TKey*) nextKey ())
+        {
+          // keys are sorted by decreasing cycle, keep only the latest one
+          if (fTreeName == key->GetName () || copied.count (key->GetName ())) continue ;
+          copied.insert (key->GetName ()) ;
+          TObject* object = key->ReadObj () ;
+          output->cd () ;
+          if (!object || object->Write (key->GetName ()) <= 0) success = false ;
+          delete object ;
+        }
+    }
+  
+  if (output)
+    {
+      output->Close () ;
+      if (output->TestBit (TFile::kWriteError)) success = false ;
+      delete output ;
+    }
+  delete buffer ;
+  for (unsigned int iInput = 0 ; iInput < files.size () ; ++iInput)
+    delete files.at (iInput) ;
+  if (!success) std::cerr << "<OutputMerger::SortedCopy>: copy into " << outputName << " failed" << std::endl ;
+  return success ;
+}
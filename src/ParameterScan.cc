@@ -0,0 +1,120 @@
+#include "ParameterScan.hh"
+#include "ShashlikRunManager.hh"
+#include "CreateTree.hh"
+#include "DetectorConstruction.hh"
+
+#include <fstream>
+#include <sstream>
+
+#include "TNamed.h"
+#include "TString.h"
+
+#include "G4UImanager.hh"
+
+
+
+ParameterScan::ParameterScan (ShashlikRunManager* runManager, CreateTree* tree, const ConfigFile& baseConfig) :
+  fRunManager (runManager),
+  fTree (tree),
+  fBaseConfig (baseConfig)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+ParameterScan::~ParameterScan ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The keys of the points are checked here, before any point is simulated:
+only the ones the run manager can apply to the built detector are accepted.
+*/
+G4bool ParameterScan::ReadPoints (const std::string& scanFileName)
+{
+  std::ifstream scanFile (scanFileName.c_str ()) ;
+  if (!scanFile)
+    {
+      G4cerr << "<ParameterScan::ReadPoints>: cannot read " << scanFileName << G4endl ;
+      return false ;
+    }
+  
+  std::string line ;
+  while (std::getline (scanFile, line))
+    {
+      line = line.substr (0, line.find ('#')) ;
+      if (line.find_first_not_of (" \t") == std::string::npos) continue ;
+      
+      std::istringstream settings (line) ;
+      std::string setting ;
+      while (settings >> setting)
+        {
+          std::string key = setting.substr (0, setting.find ('=')) ;
+          if (setting.find ('=') == std::string::npos || key == "" || !DetectorConstruction::IsUpdatable (key))
+            {
+              G4cerr << "<ParameterScan::ReadPoints>: '" << setting << "' at point " << fPoints.size () 
+                     << " is not a setting of the detector that can be scanned" << G4endl ;
+              return false ;
+            }
+        }
+      fPoints.push_back (line) ;
+    }
+  
+  G4cout << ">>> ParameterScan: " << fPoints.size () << " points read from " << scanFileName << " <<<" << G4endl ;
+  return fPoints.size () > 0 ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Each point starts again from the base configuration, so that the settings
+of a point do not leak into the following ones.
+The event numbering goes on across the points, so that all the events
+get different seeds.
+*/
+G4bool ParameterScan::Run (const std::string& macroFileName)
+{
+  G4UImanager* UImanager = G4UImanager::GetUIpointer () ;
+  
+  for (unsigned int iPoint = 0 ; iPoint < fPoints.size () ; ++iPoint)
+    {
+      ConfigFile config (fBaseConfig) ;
+      std::istringstream settings (fPoints.at (iPoint)) ;
+      std::string setting ;
+      while (settings >> setting)
+        {
+          std::string::size_type equal = setting.find ('=') ;
+          if (equal == std::string::npos || equal == 0)
+            {
+              G4cerr << "<ParameterScan::Run>: bad setting '" << setting << "' at point " << iPoint << G4endl ;
+              return false ;
+            }
+          config.add (setting.substr (0, equal), setting.substr (equal + 1)) ;
+        }
+      
+      G4cout << ">>> ParameterScan: point " << iPoint << ": " << fPoints.at (iPoint) << " <<<" << G4endl ;
+      if (fRunManager->Reconfigure (config) == ShashlikRunManager::kRejected)
+        {
+          G4cerr << "<ParameterScan::Run>: point " << iPoint << " cannot be applied" << G4endl ;
+          return false ;
+        }
+      
+      fTree->ScanPoint = iPoint ;
+      if (UImanager->ApplyCommand ("/control/execute " + macroFileName) != 0)
+        {
+          G4cerr << "<ParameterScan::Run>: macro " << macroFileName << " failed at point " << iPoint << G4endl ;
+          return false ;
+        }
+      
+      TNamed pointInfo (Form ("scanPoint_%d", iPoint), fPoints.at (iPoint).c_str ()) ;
+      fTree->WriteObject (&pointInfo) ;
+    }
+  
+  return true ;
+}
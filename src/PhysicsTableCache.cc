@@ -0,0 +1,215 @@
+#include "PhysicsTableCache.hh"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "G4VUserPhysicsList.hh"
+#include "G4Material.hh"
+#include "G4Element.hh"
+#include "G4IonisParamMat.hh"
+#include "G4RegionStore.hh"
+#include "G4Region.hh"
+#include "G4ProductionCuts.hh"
+#include "G4Version.hh"
+
+
+
+namespace
+{
+  // 64 bits FNV-1a hash, enough to name the cache directories
+  unsigned long long hash (const std::string& text)
+  {
+    unsigned long long h = 0xCBF29CE484222325ULL ;
+    for (unsigned int i = 0 ; i < text.size () ; ++i)
+      {
+        h ^= (unsigned char) text[i] ;
+        h *= 0x100000001B3ULL ;
+      }
+    return h ;
+  }
+  
+  // the tables are stored as plain files in one directory
+  void removeDir (const std::string& dirName)
+  {
+    DIR* dir = opendir (dirName.c_str ()) ;
+    if (!dir) return ;
+    struct dirent* entry ;
+    while ((entry = readdir (dir)) != NULL)
+      {
+        std::string name = entry->d_name ;
+        if (name != "." && name != "..") unlink ((dirName + "/" + name).c_str ()) ;
+      }
+    closedir (dir) ;
+    rmdir (dirName.c_str ()) ;
+  }
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+PhysicsTableCache::PhysicsTableCache (const std::string& cacheDir, const std::string& physicsListName, G4VUserPhysicsList* physics) :
+  fCacheDir (cacheDir),
+  fPhysicsListName (physicsListName),
+  fPhysics (physics),
+  fRetrieved (false)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+PhysicsTableCache::~PhysicsTableCache ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Everything the stored tables depend on: Geant4 version, physics list,
+composition and ionisation parameters of all the materials, production cuts
+of the default and of every region that has its own.
+*/
+std::string PhysicsTableCache::MakeKey () const
+{
+  std::ostringstream key ;
+  key.precision (10) ;
+  key << "geant4 " << G4VERSION_NUMBER << "\n" ;
+  key << "physics " << fPhysicsListName << "\n" ;
+  
+  const G4MaterialTable* materials = G4Material::GetMaterialTable () ;
+  for (unsigned int iMat = 0 ; iMat < materials->size () ; ++iMat)
+    {
+      const G4Material* material = materials->at (iMat) ;
+      key << "material " << material->GetName () 
+          << " " << material->GetDensity () 
+          << " " << material->GetState ()
+          << " " << material->GetTemperature ()
+          << " " << material->GetIonisation ()->GetMeanExcitationEnergy () ;
+      for (unsigned int iEl = 0 ; iEl < material->GetNumberOfElements () ; ++iEl)
+        key << " " << material->GetElement (iEl)->GetZ () 
+            << ":" << material->GetFractionVector ()[iEl] ;
+      key << "\n" ;
+    }
+  
+  key << "cuts " << fPhysics->GetDefaultCutValue () 
+      << " " << fPhysics->GetCutValue ("gamma") 
+      << " " << fPhysics->GetCutValue ("e-") 
+      << " " << fPhysics->GetCutValue ("e+") 
+      << " " << fPhysics->GetCutValue ("proton") << "\n" ;
+  
+  const G4RegionStore* regions = G4RegionStore::GetInstance () ;
+  for (unsigned int iReg = 0 ; iReg < regions->size () ; ++iReg)
+    {
+      const G4ProductionCuts* cuts = regions->at (iReg)->GetProductionCuts () ;
+      if (!cuts) continue ;
+      key << "region " << regions->at (iReg)->GetName () ;
+      for (G4int index = 0 ; index < NumberOfG4CutIndex ; ++index) key << " " << cuts->GetProductionCut (index) ;
+      key << "\n" ;
+    }
+  
+  return key.str () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+std::string PhysicsTableCache::TablesDir () const
+{
+  char name[32] ;
+  sprintf (name, "%016llx", hash (fKey)) ;
+  return fCacheDir + "/" + name ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool PhysicsTableCache::Retrieve ()
+{
+  if (!IsEnabled ()) return false ;
+  
+  fKey = MakeKey () ;
+  std::string tablesDir = TablesDir () ;
+  
+  std::ifstream keyFile ((tablesDir + "/key.txt").c_str ()) ;
+  if (!keyFile)
+    {
+      G4cout << ">>> PhysicsTableCache: no tables in " << tablesDir << ", they will be built <<<" << G4endl ;
+      return false ;
+    }
+  std::stringstream storedKey ;
+  storedKey << keyFile.rdbuf () ;
+  if (storedKey.str () != fKey)
+    {
+      G4cout << ">>> PhysicsTableCache: the tables in " << tablesDir << " do not match, they will be built <<<" << G4endl ;
+      return false ;
+    }
+  
+  G4cout << ">>> PhysicsTableCache: retrieving the tables from " << tablesDir << " <<<" << G4endl ;
+  fPhysics->SetPhysicsTableRetrieved (tablesDir) ;
+  fRetrieved = true ;
+  return true ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The tables are written to a directory of this process and then moved in place,
+so that concurrent jobs never see incomplete tables:
+the first job to finish fills the cache, the others drop their copy.
+*/
+G4bool PhysicsTableCache::Store ()
+{
+  if (!IsEnabled ()) return false ;
+  if (fRetrieved)
+    {
+      // the tables of later cut or material changes are built, not looked up in the cache
+      fPhysics->ResetPhysicsTableRetrieved () ;
+      return false ;
+    }
+  
+  if (fKey == "") fKey = MakeKey () ;
+  std::string tablesDir = TablesDir () ;
+  std::ostringstream tmpName ;
+  tmpName << tablesDir << ".tmp" << getpid () ;
+  std::string tmpDir = tmpName.str () ;
+  
+  mkdir (fCacheDir.c_str (), 0755) ;
+  if (mkdir (tmpDir.c_str (), 0755) != 0)
+    {
+      G4cerr << "<PhysicsTableCache::Store>: cannot create " << tmpDir << ": " << strerror (errno) << G4endl ;
+      return false ;
+    }
+  
+  if (!fPhysics->StorePhysicsTable (tmpDir))
+    {
+      G4cerr << "<PhysicsTableCache::Store>: cannot store the tables in " << tmpDir << G4endl ;
+      removeDir (tmpDir) ;
+      return false ;
+    }
+  std::ofstream keyFile ((tmpDir + "/key.txt").c_str ()) ;
+  keyFile << fKey ;
+  keyFile.close () ;
+  
+  if (rename (tmpDir.c_str (), tablesDir.c_str ()) != 0)
+    {
+      // another job got there first, or a stale directory is in the way
+      G4cout << ">>> PhysicsTableCache: " << tablesDir << " already filled <<<" << G4endl ;
+      removeDir (tmpDir) ;
+      return false ;
+    }
+  
+  G4cout << ">>> PhysicsTableCache: tables stored in " << tablesDir << " <<<" << G4endl ;
+  return true ;
+}
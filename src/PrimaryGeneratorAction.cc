@@ -41,6 +41,8 @@
 #include "G4GeneralParticleSource.hh"
 
 #include "CreateTree.hh"
+#include "EventSeeder.hh"
+#include "ShashlikRunManager.hh"
 
 
 
@@ -68,5 +70,15 @@ PrimaryGeneratorAction::~PrimaryGeneratorAction()
 
 void PrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 {
+  // the random sequence of each event depends only on the master seed and on the global event number
+  EventSeeder::SeedEvent(ShashlikRunManager::GetEventOffset() + anEvent->GetEventID());
+  
   gun->GeneratePrimaryVertex(anEvent);
 }
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void PrimaryGeneratorAction::SetPosCentre(const G4ThreeVector& posCentre)
+{
+  gun->GetCurrentSource()->GetPosDist()->SetCentreCoords(posCentre);
+}
@@ -33,9 +33,14 @@
 // Make this appear first!
 
 #include "RunAction.hh"
+#include "StartupProfiler.hh"
+#include "StackingAction.hh"
+#include "LightCollectionTable.hh"
+#include "ShashlikRunManager.hh"
 
 #include "G4Timer.hh"
 #include "G4Run.hh"
+#include "G4RunManager.hh"
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
@@ -55,7 +60,15 @@ RunAction::~RunAction()
 
 void RunAction::BeginOfRunAction(const G4Run* aRun)
 {
+  // the macro that started the run is done with the setup
+  StartupProfiler::EndPhase("GPS macro");
+  
   G4cout << "### Run :: " << aRun->GetRunID() << " started ..." << G4endl; 
+  
+  // the photons removed by the stacking policy are counted run by run
+  StackingAction* stacking = (StackingAction*)G4RunManager::GetRunManager()->GetUserStackingAction();
+  if( stacking ) stacking->ResetCounters();
+  
   timer->Start();
 }
 
@@ -66,6 +79,18 @@ void RunAction::EndOfRunAction(const G4Run* aRun)
   timer->Stop();
   G4cout << "number of event = " << aRun->GetNumberOfEvent() 
          << " " << *timer << G4endl;
+  
+  const StackingAction* stacking = (const StackingAction*)G4RunManager::GetRunManager()->GetUserStackingAction();
+  if( stacking ) stacking->PrintCounters();
+  
+  // the calibration counts of each run go to a file of their own
+  LightCollectionTable* lightTable = LightCollectionTable::Instance();
+  if( lightTable && lightTable->GetMode() == LightCollectionTable::kCalibration ) lightTable->Save();
+  
+#ifdef G4MULTITHREADED
+  // the event IDs of each run start from 0, the next run numbers its events after these
+  if( IsMaster() ) ShashlikRunManager::AdvanceEventOffset(aRun->GetNumberOfEventToBeProcessed());
+#endif
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,232 @@
+#include "ShashlikRunManager.hh"
+#include "DetectorConstruction.hh"
+#include "PrimaryGeneratorAction.hh"
+#include "ConfigFile.hh"
+
+#include "G4GeometryManager.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4SolidStore.hh"
+#include "G4VUserDetectorConstruction.hh"
+#include "G4VUserPhysicsList.hh"
+
+#include <algorithm>
+#include <set>
+#include <cstdio>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+
+G4int ShashlikRunManager::fEventOffset = 0 ;
+G4int ShashlikRunManager::fFirstEvent  = 0 ;
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+ShashlikRunManager::ShashlikRunManager () :
+  G4RunManager (),
+  fWorkerIndex (0),
+  fNWorkers (1),
+  fEventsBefore (0),
+  fEventsToSkip (0),
+  fConfig (NULL)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+ShashlikRunManager::~ShashlikRunManager ()
+{
+  delete fConfig ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+Each worker gets a contiguous slice of the n_event requested,
+the first n_event % fNWorkers workers get one event more.
+Events to be skipped are taken from the beginning of the slice.
+*/
+void ShashlikRunManager::BeamOn (G4int n_event, const char* macroFile, G4int n_select)
+{
+  G4int firstEvent = 0 ;
+  G4int nEvents = n_event ;
+  if (fNWorkers > 1 && n_event > 0)
+    {
+      G4int remainder = n_event % fNWorkers ;
+      nEvents = n_event / fNWorkers + (fWorkerIndex < remainder ? 1 : 0) ;
+      firstEvent = n_event / fNWorkers * fWorkerIndex + std::min (fWorkerIndex, remainder) ;
+      G4cout << ">>> worker " << fWorkerIndex << " processes events " 
+             << firstEvent << " to " << firstEvent + nEvents - 1 << " <<<" << G4endl ;
+    }
+  
+  G4int skip = std::min (fEventsToSkip, nEvents) ;
+  if (skip > 0)
+    {
+      G4cout << ">>> skipping the " << skip << " events already done <<<" << G4endl ;
+      firstEvent += skip ;
+      nEvents -= skip ;
+      fEventsToSkip -= skip ;
+    }
+  
+  fEventOffset = fEventsBefore + firstEvent ;
+  if (n_event > 0) fEventsBefore += n_event ;
+  
+  G4RunManager::BeamOn (nEvents, macroFile, n_select) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4int ShashlikRunManager::ForkWorkers (G4int nWorkers)
+{
+  // do not let the children inherit and flush again the pending output
+  G4cout << G4endl ;
+  fflush (stdout) ;
+  fflush (stderr) ;
+  
+  for (G4int iWorker = 0 ; iWorker < nWorkers ; ++iWorker)
+    {
+      pid_t pid = fork () ;
+      if (pid < 0)
+        {
+          G4cerr << "<ShashlikRunManager::ForkWorkers>: fork of worker " << iWorker << " failed" << G4endl ;
+          // the slices would not cover all the events, stop the workers already started
+          for (unsigned int iStarted = 0 ; iStarted < fWorkerPIDs.size () ; ++iStarted)
+            {
+              kill (fWorkerPIDs.at (iStarted), SIGTERM) ;
+              waitpid (fWorkerPIDs.at (iStarted), NULL, 0) ;
+            }
+          fWorkerPIDs.clear () ;
+          return -1 ;
+        }
+      if (pid == 0)
+        {
+          fWorkerIndex = iWorker ;
+          fNWorkers = nWorkers ;
+          fWorkerPIDs.clear () ;
+          return iWorker ;
+        }
+      fWorkerPIDs.push_back (pid) ;
+    }
+  
+  fNWorkers = nWorkers ;
+  return -1 ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool ShashlikRunManager::WaitForWorkers ()
+{
+  G4bool success = (fWorkerPIDs.size () > 0) ;
+  for (unsigned int iWorker = 0 ; iWorker < fWorkerPIDs.size () ; ++iWorker)
+    {
+      int status = 0 ;
+      if (waitpid (fWorkerPIDs.at (iWorker), &status, 0) < 0 || 
+          !WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+          G4cerr << "<ShashlikRunManager::WaitForWorkers>: worker " << iWorker << " failed" << G4endl ;
+          success = false ;
+        }
+    }
+  fWorkerPIDs.clear () ;
+  return success ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The volumes and solids of the previous geometry are deleted,
+the materials are left untouched and so are the physics tables built for them.
+*/
+void ShashlikRunManager::RebuildGeometry ()
+{
+  G4GeometryManager::GetInstance ()->OpenGeometry () ;
+  ((DetectorConstruction*) userDetector)->ReleaseRegions () ;
+  G4PhysicalVolumeStore::GetInstance ()->Clean () ;
+  G4LogicalVolumeStore::GetInstance ()->Clean () ;
+  G4SolidStore::GetInstance ()->Clean () ;
+  
+  DefineWorldVolume (userDetector->Construct ()) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void ShashlikRunManager::SetConfig (const ConfigFile& config)
+{
+  delete fConfig ;
+  fConfig = new ConfigFile (config) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The new configuration is compared with the one applied, key by key:
+the actions, the physics and the processes read theirs at construction,
+so only the keys of the DetectorConstruction can change.
+The physics tables are marked for a rebuild only when the materials changed,
+otherwise the ones already built are used with the new geometry.
+The beam is kept at the front face of the module.
+*/
+G4int ShashlikRunManager::Reconfigure (const ConfigFile& config, const std::vector<std::string>& callerKeys)
+{
+  if (fConfig)
+    {
+      std::set<std::string> keys ;
+      for (std::map<std::string, std::string>::const_iterator it = fConfig->myContents.begin () ; it != fConfig->myContents.end () ; ++it)
+        keys.insert (it->first) ;
+      for (std::map<std::string, std::string>::const_iterator it = config.myContents.begin () ; it != config.myContents.end () ; ++it)
+        keys.insert (it->first) ;
+      
+      G4bool rejected = false ;
+      for (std::set<std::string>::const_iterator key = keys.begin () ; key != keys.end () ; ++key)
+        {
+          if (DetectorConstruction::IsUpdatable (*key) ||
+              std::find (callerKeys.begin (), callerKeys.end (), *key) != callerKeys.end ()) continue ;
+          if (fConfig->read<std::string> (*key, "") == config.read<std::string> (*key, "")) continue ;
+          G4cerr << "<ShashlikRunManager::Reconfigure>: " << *key << " is read only at construction, it cannot change from '"
+                 << fConfig->read<std::string> (*key, "") << "' to '" << config.read<std::string> (*key, "") << "'" << G4endl ;
+          rejected = true ;
+        }
+      if (rejected) return kRejected ;
+    }
+  
+  DetectorConstruction* detector = (DetectorConstruction*) userDetector ;
+  G4int changes = detector->UpdateConfig (config) ;
+  SetConfig (config) ;
+  
+  if (changes & DetectorConstruction::kGeometryChanged)
+    {
+      G4cout << ">>> ShashlikRunManager: rebuilding the geometry <<<" << G4endl ;
+      RebuildGeometry () ;
+      
+      PrimaryGeneratorAction* generator = (PrimaryGeneratorAction*) userPrimaryGeneratorAction ;
+      if (generator) generator->SetPosCentre (G4ThreeVector (0., 0., -0.5 * detector->GetModule_z ())) ;
+    }
+  if (changes & DetectorConstruction::kMaterialsChanged)
+    {
+      G4cout << ">>> ShashlikRunManager: new materials, the physics tables will be rebuilt <<<" << G4endl ;
+      // tables retrieved from the cache were made for the old materials
+      physicsList->ResetPhysicsTableRetrieved () ;
+      PhysicsHasBeenModified () ;
+    }
+  if (changes == DetectorConstruction::kNothingChanged)
+    G4cout << ">>> ShashlikRunManager: detector configuration unchanged <<<" << G4endl ;
+  
+  return changes ;
+}
@@ -0,0 +1,163 @@
+#include "SimulationServer.hh"
+#include "ShashlikRunManager.hh"
+#include "CreateTree.hh"
+#include "ConfigFile.hh"
+#include "EventSeeder.hh"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "G4UImanager.hh"
+
+
+
+SimulationServer::SimulationServer (ShashlikRunManager* runManager, CreateTree* tree, const std::string& fifoName) :
+  fRunManager (runManager),
+  fTree (tree),
+  fFifoName (fifoName),
+  fBaseSeed (EventSeeder::GetMasterSeed ()),
+  fNRequests (0)
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+SimulationServer::~SimulationServer ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The FIFO is opened again each time the writer side closes it,
+so that any number of clients can send requests one after the other.
+*/
+G4int SimulationServer::Serve ()
+{
+  if (mkfifo (fFifoName.c_str (), 0600) != 0 && errno != EEXIST)
+    {
+      G4cerr << "<SimulationServer::Serve>: cannot create FIFO " << fFifoName << ": " << strerror (errno) << G4endl ;
+      return 1 ;
+    }
+  
+  G4int nFailed = 0 ;
+  while (true)
+    {
+      G4cout << ">>> SimulationServer: waiting for requests on " << fFifoName << " <<<" << G4endl ;
+      std::ifstream fifo (fFifoName.c_str ()) ;
+      std::string request ;
+      while (std::getline (fifo, request))
+        {
+          if (request.find_first_not_of (" \t") == std::string::npos) continue ;
+          if (request == "quit")
+            {
+              G4cout << ">>> SimulationServer: quit <<<" << G4endl ;
+              return nFailed ;
+            }
+          if (!Process (request)) ++nFailed ;
+        }
+    }
+  return nFailed ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool SimulationServer::Process (const std::string& request)
+{
+  G4cout << ">>> SimulationServer: request '" << request << "' <<<" << G4endl ;
+  
+  std::istringstream fields (request) ;
+  std::string macroFileName, outputName, configFileName ;
+  fields >> macroFileName >> outputName >> configFileName ;
+  if (outputName == "")
+    {
+      G4cerr << "<SimulationServer::Process>: syntax is <macro file> <output file> [<configuration file>]" << G4endl ;
+      Reply ("failed " + request) ;
+      return false ;
+    }
+  
+  G4long seed = -1 ;
+  if (configFileName != "" && !Configure (configFileName, seed))
+    {
+      Reply ("failed " + outputName) ;
+      return false ;
+    }
+  // the seed of the server itself, as in a copy of its configuration, is not a new one
+  if (seed == -1 || seed == fBaseSeed) seed = EventSeeder::DerivedSeed (fBaseSeed, fNRequests) ;
+  ++fNRequests ;
+  EventSeeder::SetMasterSeed (seed) ;
+  G4cout << ">>> SimulationServer: master seed " << seed << " <<<" << G4endl ;
+  
+  if (!fTree->OpenFile (outputName + ".root"))
+    {
+      G4cerr << "<SimulationServer::Process>: cannot open " << outputName << ".root" << G4endl ;
+      Reply ("failed " + outputName) ;
+      return false ;
+    }
+  
+  fRunManager->ResetEventNumbering () ;
+  G4int status = G4UImanager::GetUIpointer ()->ApplyCommand ("/control/execute " + macroFileName) ;
+  fTree->CloseFile () ;
+  
+  Reply ((status == 0 ? "done " : "failed ") + outputName) ;
+  return status == 0 ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The seed is applied by Process, all the other keys by the run manager,
+which rejects the ones it cannot change any more.
+*/
+G4bool SimulationServer::Configure (const std::string& configFileName, G4long& seed)
+{
+  ConfigFile* config = NULL ;
+  try
+    {
+      config = new ConfigFile (configFileName) ;
+    }
+  catch (ConfigFile::file_not_found& e)
+    {
+      G4cerr << "<SimulationServer::Configure>: configuration file " << e.filename << " not found" << G4endl ;
+      return false ;
+    }
+  
+  seed = config->read<long int> ("seed", -1) ;
+  
+  G4int changes = fRunManager->Reconfigure (*config, std::vector<std::string> (1, "seed")) ;
+  delete config ;
+  
+  return changes != ShashlikRunManager::kRejected ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The reply FIFO is opened without blocking, nobody listening is not an error.
+*/
+void SimulationServer::Reply (const std::string& message) const
+{
+  G4cout << ">>> SimulationServer: " << message << " <<<" << G4endl ;
+  
+  std::string replyName = fFifoName + ".reply" ;
+  int fd = open (replyName.c_str (), O_WRONLY | O_NONBLOCK) ;
+  if (fd < 0) return ;
+  std::string line = message + "\n" ;
+  if (write (fd, line.c_str (), line.size ()) < 0)
+    G4cerr << "<SimulationServer::Reply>: cannot write to " << replyName << G4endl ;
+  close (fd) ;
+}
@@ -0,0 +1,245 @@
+#include "StackingAction.hh"
+#include "DetectorConstruction.hh"
+#include "FiberVolumeTable.hh"
+#include "LightCollectionTable.hh"
+#include "CreateTree.hh"
+
+#include <algorithm>
+#include <vector>
+
+#include "G4RunManager.hh"
+#include "G4Track.hh"
+#include "G4VProcess.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4SystemOfUnits.hh"
+
+
+
+StackingAction::StackingAction (const ConfigFile& config)
+{
+  fDetector = (const DetectorConstruction*) G4RunManager::GetRunManager ()->GetUserDetectorConstruction () ;
+  fFiberTable = fDetector->GetFiberTable () ;
+  
+  config.readIntoVect (fKillVolumes, "stack_killVolumes") ;
+  fMaxDistance   = config.read<double> ("stack_maxDistance", -1.) * mm ;
+  fMinCosToFiber = config.read<double> ("stack_minCosToFiber", -2.) ;
+  fDeferDistance = config.read<double> ("stack_deferDistance", -1.) * mm ;
+  fNeedsFiber = (fMaxDistance >= 0. || fMinCosToFiber >= -1. || fDeferDistance >= 0.) ;
+  
+  // same fraction given to the scintillation process by G4EmUserPhysics
+  fScintFraction = config.read<double> ("scint_fraction", 1.) ;
+  if (fScintFraction <= 0. || fScintFraction > 1.) fScintFraction = 1. ;
+  fScintillation = NULL ;
+  fTileThreshold = config.read<double> ("optical_tileThreshold", -1.) * MeV ;
+  fStage = 0 ;
+  
+  G4cout << ">>> StackingAction: optical photons killed in " << fKillVolumes.size () << " volumes" ;
+  if (fMaxDistance >= 0.)    G4cout << ", farther than " << fMaxDistance / mm << " mm from the fibers" ;
+  if (fMinCosToFiber >= -1.) G4cout << ", heading away from the fibers (cos < " << fMinCosToFiber << ")" ;
+  if (fDeferDistance >= 0.)  G4cout << ", deferred farther than " << fDeferDistance / mm << " mm" ;
+  if (fScintFraction < 1.)   G4cout << ", scintillation photons weighted 1/" << fScintFraction ;
+  if (fTileThreshold > 0.)   G4cout << ", in the tiles with less than " << fTileThreshold / MeV << " MeV" ;
+  G4cout << " <<<" << G4endl ;
+  
+  ResetCounters () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+StackingAction::~StackingAction ()
+{}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+With a tile threshold the photons of the crystals that pass the rules wait
+until all the other particles of the event are tracked, then the ones from
+the layers with less deposit than the threshold are killed.
+*/
+G4ClassificationOfNewTrack StackingAction::ClassifyNewTrack (const G4Track* track)
+{
+  if (track->GetDefinition () != G4OpticalPhoton::OpticalPhotonDefinition ()) return fUrgent ;
+  if (fStage > 0 && fTileThreshold > 0.) return ClassifyByTile (track) ;
+  ++fNPhotons ;
+  
+  // the weight of the thinned photons, set once when they are stacked
+  if (fScintFraction < 1. && IsScintillation (track->GetCreatorProcess ()))
+    const_cast<G4Track*> (track)->SetWeight (track->GetWeight () / fScintFraction) ;
+  
+  G4ClassificationOfNewTrack classification = ApplyRules (track) ;
+  if (classification != fKill && fTileThreshold > 0. &&
+      fDetector->GetCrystalLayer (track->GetVolume (), track->GetTouchable ()) >= 0) return fWaiting ;
+  if (classification != fKill) CountEmission (track) ;
+  return classification ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The rules are applied in order: creation volume, distance, direction,
+the first one that kills the photon is the one counted.
+The scintillation photons of the crystals replaced by the light collection
+table are killed before any rule, the Cherenkov ones are still tracked.
+*/
+G4ClassificationOfNewTrack StackingAction::ApplyRules (const G4Track* track)
+{
+  const G4VPhysicalVolume* volume = track->GetVolume () ;
+  const LightCollectionTable* lightTable = LightCollectionTable::Instance () ;
+  if (lightTable && lightTable->GetMode () != LightCollectionTable::kCalibration && lightTable->IsLoaded () &&
+      volume && volume == fDetector->GetCrystalPV () && IsScintillation (track->GetCreatorProcess ()))
+    {
+      ++fReplacedByTable ;
+      return fKill ;
+    }
+  
+  if (volume && !fKillVolumes.empty () &&
+      std::find (fKillVolumes.begin (), fKillVolumes.end (), std::string (volume->GetName ())) != fKillVolumes.end ())
+    {
+      ++fKilledByVolume ;
+      return fKill ;
+    }
+  
+  if (!fNeedsFiber) return fUrgent ;
+  
+  G4TwoVector position (track->GetPosition ().x (), track->GetPosition ().y ()) ;
+  G4double distance ;
+  G4int fiber = fFiberTable->FindNearestFiber (position, distance) ;
+  if (fiber < 0) return fUrgent ;
+  
+  if (fMaxDistance >= 0. && distance > fMaxDistance)
+    {
+      ++fKilledByDistance ;
+      return fKill ;
+    }
+  
+  if (fMinCosToFiber >= -1. && distance > 0.)
+    {
+      G4TwoVector direction (track->GetMomentumDirection ().x (), track->GetMomentumDirection ().y ()) ;
+      // photons along the fibers have no transverse direction to judge,
+      // the others are killed only if they head away from the fibers of every chamfer
+      if (direction.mag2 () > 1.e-12 && 
+          !fFiberTable->IsHeadingToFibers (position, direction.unit (), fMinCosToFiber))
+        {
+          ++fKilledByDirection ;
+          return fKill ;
+        }
+    }
+  
+  if (fDeferDistance >= 0. && distance > fDeferDistance)
+    {
+      ++fDeferred ;
+      return fWaiting ;
+    }
+  
+  return fUrgent ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4ClassificationOfNewTrack StackingAction::ClassifyByTile (const G4Track* track)
+{
+  G4int layer = fDetector->GetCrystalLayer (track->GetVolume (), track->GetTouchable ()) ;
+  const std::vector<float>& deposit = *(CreateTree::Instance ()->depositInLayer) ;
+  if (layer < 0 || layer >= int (deposit.size ()) || deposit[layer] >= fTileThreshold / MeV)
+    {
+      CountEmission (track) ;
+      return fUrgent ;
+    }
+  ++fKilledByThreshold ;
+  return fKill ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The calibration counts the scintillation photons of the crystals that
+survive the stacking rules, the same ones FiberCoreSD can collect.
+*/
+void StackingAction::CountEmission (const G4Track* track)
+{
+  LightCollectionTable* lightTable = LightCollectionTable::Instance () ;
+  if (!lightTable || lightTable->GetMode () != LightCollectionTable::kCalibration) return ;
+  if (track->GetVolume () != fDetector->GetCrystalPV () || !IsScintillation (track->GetCreatorProcess ())) return ;
+  lightTable->Emit (track->GetPosition ()) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The waiting photons are moved to the urgent stack before each new stage,
+they are classified again by tile at the first one.
+*/
+void StackingAction::NewStage ()
+{
+  ++fStage ;
+  if (fStage == 1 && fTileThreshold > 0.) stackManager->ReClassify () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+The fraction goes to the tree with each event, so that the analyses
+of the weighted totals can correct their variance.
+*/
+void StackingAction::PrepareNewEvent ()
+{
+  fStage = 0 ;
+  CreateTree::Instance ()->ScintFraction = fScintFraction ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4bool StackingAction::IsScintillation (const G4VProcess* process)
+{
+  if (!process) return false ;
+  if (!fScintillation && process->GetProcessName () == "Scintillation") fScintillation = process ;
+  return process == fScintillation ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void StackingAction::ResetCounters ()
+{
+  fNPhotons = 0 ;
+  fKilledByVolume = 0 ;
+  fKilledByDistance = 0 ;
+  fKilledByDirection = 0 ;
+  fDeferred = 0 ;
+  fReplacedByTable = 0 ;
+  fKilledByThreshold = 0 ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void StackingAction::PrintCounters () const
+{
+  G4double norm = fNPhotons > 0 ? 100. / fNPhotons : 0. ;
+  G4cout << ">>> StackingAction: " << fNPhotons << " optical photons created <<<\n"
+         << "    killed by volume:    " << fKilledByVolume    << " (" << fKilledByVolume * norm    << "%)\n"
+         << "    killed by distance:  " << fKilledByDistance  << " (" << fKilledByDistance * norm  << "%)\n"
+         << "    killed by direction: " << fKilledByDirection << " (" << fKilledByDirection * norm << "%)\n"
+         << "    deferred:            " << fDeferred          << " (" << fDeferred * norm          << "%)\n"
+         << "    replaced by table:   " << fReplacedByTable   << " (" << fReplacedByTable * norm   << "%)\n"
+         << "    killed by threshold: " << fKilledByThreshold << " (" << fKilledByThreshold * norm << "%)" << G4endl ;
+}
@@ -0,0 +1,165 @@
+#include "StartupProfiler.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "TTree.h"
+
+#ifdef G4MULTITHREADED
+#include "G4AutoLock.hh"
+namespace { G4Mutex profilerMutex = G4MUTEX_INITIALIZER ; }
+#endif
+
+
+std::vector<StartupProfiler::Phase> StartupProfiler::fPhases ;
+std::vector<int>                    StartupProfiler::fOpenPhases ;
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+While a phase is open its times and memory hold the values at its beginning,
+EndPhase turns them into differences.
+*/
+void StartupProfiler::BeginPhase (const G4String& name)
+{
+#ifdef G4MULTITHREADED
+  G4AutoLock lock (&profilerMutex) ;
+#endif
+  Phase phase ;
+  phase.name      = name ;
+  phase.depth     = fOpenPhases.size () ;
+  phase.open      = true ;
+  phase.wallTime  = WallTime () ;
+  phase.cpuTime   = CpuTime () ;
+  phase.rss       = 0. ;
+  phase.rssGrowth = Rss () ;
+  fOpenPhases.push_back (fPhases.size ()) ;
+  fPhases.push_back (phase) ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void StartupProfiler::EndPhase (const G4String& name)
+{
+#ifdef G4MULTITHREADED
+  G4AutoLock lock (&profilerMutex) ;
+#endif
+  if (fOpenPhases.empty ()) return ;
+  Phase& phase = fPhases.at (fOpenPhases.back ()) ;
+  if (phase.name != name) return ;
+  
+  phase.open      = false ;
+  phase.wallTime  = WallTime () - phase.wallTime ;
+  phase.cpuTime   = CpuTime () - phase.cpuTime ;
+  phase.rss       = Rss () ;
+  phase.rssGrowth = phase.rss - phase.rssGrowth ;
+  fOpenPhases.pop_back () ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+void StartupProfiler::Print (std::ostream& out)
+{
+  out << "\n=====>   S T A R T U P   P R O F I L E   <====\n" << std::endl ;
+  out << std::left << std::setw (36) << "phase" << std::right
+      << std::setw (12) << "wall [s]" << std::setw (12) << "CPU [s]" 
+      << std::setw (14) << "RSS +[MB]" << std::setw (12) << "RSS [MB]" << std::endl ;
+  for (unsigned int iPhase = 0 ; iPhase < fPhases.size () ; ++iPhase)
+    {
+      const Phase& phase = fPhases.at (iPhase) ;
+      if (phase.open) continue ;
+      out << std::left << std::setw (36) << std::string (2 * phase.depth, ' ') + phase.name << std::right
+          << std::fixed << std::setprecision (3)
+          << std::setw (12) << phase.wallTime << std::setw (12) << phase.cpuTime
+          << std::setprecision (1)
+          << std::setw (14) << phase.rssGrowth << std::setw (12) << phase.rss << std::endl ;
+    }
+  out.unsetf (std::ios::fixed) ;
+  out << std::endl ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+TTree* StartupProfiler::MakeTree ()
+{
+  char   name[64] ;
+  int    depth ;
+  double wallTime, cpuTime, rss, rssGrowth ;
+  
+  TTree* tree = new TTree ("startupProfile", "startupProfile") ;
+  tree->SetDirectory (0) ;
+  tree->Branch ("phase",     name,       "phase/C") ;
+  tree->Branch ("depth",     &depth,     "depth/I") ;
+  tree->Branch ("wallTime",  &wallTime,  "wallTime/D") ;
+  tree->Branch ("cpuTime",   &cpuTime,   "cpuTime/D") ;
+  tree->Branch ("rss",       &rss,       "rss/D") ;
+  tree->Branch ("rssGrowth", &rssGrowth, "rssGrowth/D") ;
+  
+  for (unsigned int iPhase = 0 ; iPhase < fPhases.size () ; ++iPhase)
+    {
+      const Phase& phase = fPhases.at (iPhase) ;
+      if (phase.open) continue ;
+      strncpy (name, phase.name.c_str (), sizeof (name) - 1) ;
+      name[sizeof (name) - 1] = '\0' ;
+      depth     = phase.depth ;
+      wallTime  = phase.wallTime ;
+      cpuTime   = phase.cpuTime ;
+      rss       = phase.rss ;
+      rssGrowth = phase.rssGrowth ;
+      tree->Fill () ;
+    }
+  tree->ResetBranchAddresses () ;
+  return tree ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4double StartupProfiler::WallTime ()
+{
+  struct timeval now ;
+  gettimeofday (&now, NULL) ;
+  return now.tv_sec + 1.e-6 * now.tv_usec ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+/**
+CPU time of the whole process, user and system, all threads included.
+*/
+G4double StartupProfiler::CpuTime ()
+{
+  struct rusage usage ;
+  getrusage (RUSAGE_SELF, &usage) ;
+  return usage.ru_utime.tv_sec + 1.e-6 * usage.ru_utime.tv_usec 
+       + usage.ru_stime.tv_sec + 1.e-6 * usage.ru_stime.tv_usec ;
+}
+
+
+// ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+G4double StartupProfiler::Rss ()
+{
+  long pages = 0 ;
+  FILE* statm = fopen ("/proc/self/statm", "r") ;
+  if (!statm) return 0. ;
+  if (fscanf (statm, "%*ld %ld", &pages) != 1) pages = 0 ;
+  fclose (statm) ;
+  return pages * (sysconf (_SC_PAGESIZE) / 1048576.) ;
+}
@@ -1,24 +1,186 @@
 #!/usr/bin/python
+# Run a simulation sample on the cores of the local machine.
+#
+# The requested events are split in work units, each one simulated by a
+# separate Shashlik job in its own directory. The units share the master seed
+# and cover different event ranges (firstEvent in the configuration), so that
+# every event gets its own seed and the sample does not depend on the splitting.
+# Units are handed out to the workers as these get free, each worker pinned
+# to a core, failed units are retried. At the end the unit outputs are merged
+# into <output>.root and the run is described in <output>_manifest.json.
 
+from __future__ import print_function
 
 import sys
 import os
-from commands import getstatusoutput
-import datetime
+import re
+import json
+import time
+import shutil
+import socket
+import argparse
+import subprocess
 
 
 # ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
 
 
-def prepareJob (jobID):
-    filename = 'job_' + jobID
-    f = open (filename, 'w')
-    f.write ('cd /afs/cern.ch/user/g/govoni/w0/shashlik/Shashlik\n')
-    f.write ('source setup_lxplus.sh\n')
-    f.write ('/afs/cern.ch/user/g/govoni/geant4_workdir/bin/Linux-g++/Shashlik config.cfg out_' + jobID + '\n')
+def findExecutable (name):
+    candidates = []
+    if 'G4WORKDIR' in os.environ and 'G4SYSTEM' in os.environ :
+        candidates.append (os.path.join (os.environ['G4WORKDIR'], 'bin', os.environ['G4SYSTEM'], name))
+    for path in os.environ.get ('PATH', '').split (os.pathsep) :
+        candidates.append (os.path.join (path, name))
+    for candidate in candidates :
+        if os.path.isfile (candidate) and os.access (candidate, os.X_OK) :
+            return os.path.abspath (candidate)
+    return None
+
+
+# ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+def readEvents (macroLines):
+    beamOn = [line for line in macroLines if re.match (r'\s*/run/beamOn\s', line)]
+    if len (beamOn) != 1 :
+        return None
+    return int (beamOn[0].split ()[1])
+
+
+# ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+def setConfig (configLines, settings):
+    '''replace the values of the keys in settings, append the missing ones'''
+    lines = []
+    done = set ()
+    for line in configLines :
+        match = re.match (r'\s*(\w+)\s*=', line)
+        if match and match.group (1) in settings :
+            key = match.group (1)
+            lines.append (key + ' = ' + str (settings[key]) + '   # set by submit.py\n')
+            done.add (key)
+        else :
+            lines.append (line)
+    for key in sorted (settings) :
+        if key not in done :
+            lines.append (key + ' = ' + str (settings[key]) + '   # set by submit.py\n')
+    return lines
+
+
+# ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+# the units run in their own directories, these keys hold paths that a relative
+# value would resolve there instead of where submit.py runs; the values are the defaults
+PATH_KEYS = {'physicsTableCache' : '', 'fiberLayoutCache' : '', 'lightTable_dir' : 'lightTables',
+             'gdml_export' : '', 'gdml_load' : ''}
+
+
+def absolutePaths (configLines):
+    '''the keys in PATH_KEYS with a relative value, set to the absolute path'''
+    values = dict (PATH_KEYS)
+    for line in configLines :
+        match = re.match (r'\s*(\w+)\s*=\s*([^#]*)', line)
+        if match and match.group (1) in PATH_KEYS :
+            values[match.group (1)] = match.group (2).strip ()
+    settings = {}
+    for key in values :
+        if values[key] and not os.path.isabs (values[key]) :
+            settings[key] = os.path.abspath (values[key])
+    return settings
+
+
+# ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+def prepareUnit (unit, workDir, configLines, macroLines, seed):
+    unitDir = os.path.join (workDir, 'unit_%04d' % unit['index'])
+    if not os.path.isdir (unitDir) :
+        os.makedirs (unitDir)
+
+    settings = absolutePaths (configLines)
+    settings.update ({'seed' : seed, 'firstEvent' : unit['firstEvent'], 'nForks' : 1, 'nThreads' : 1})
+    f = open (os.path.join (unitDir, 'config.cfg'), 'w')
+    f.writelines (setConfig (configLines, settings))
     f.close ()
-    getstatusoutput ('chmod 755 job_' + jobID)
-    getstatusoutput ('bsub -q 8nh job_' + jobID)
+
+    # Shashlik executes gps.mac from its working directory
+    f = open (os.path.join (unitDir, 'gps.mac'), 'w')
+    for line in macroLines :
+        if re.match (r'\s*/run/beamOn\s', line) :
+            line = '/run/beamOn %d\n' % unit['nEvents']
+        f.write (line)
+    f.close ()
+
+    unit['dir'] = unitDir
+    unit['output'] = os.path.join (unitDir, 'out')
+    unit['log'] = os.path.join (unitDir, 'log.txt')
+
+
+# ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+def pinner (core):
+    '''function run in the child before the executable, binding it to one core'''
+    def pin ():
+        if hasattr (os, 'sched_setaffinity') :
+            os.sched_setaffinity (0, [core])
+    return pin
+
+
+def startUnit (unit, executable, core):
+    command = [executable, 'config.cfg', unit['output']]
+    if not hasattr (os, 'sched_setaffinity') and findExecutable ('taskset') :
+        command = ['taskset', '-c', str (core)] + command
+    log = open (unit['log'], 'a')
+    process = subprocess.Popen (command, cwd = unit['dir'], stdout = log, stderr = subprocess.STDOUT,
+                                preexec_fn = pinner (core))
+    log.close ()
+    unit['attempts'] += 1
+    unit['core'] = core
+    unit['start'] = time.time ()
+    print ('unit', unit['index'], 'events', unit['firstEvent'], '-', unit['firstEvent'] + unit['nEvents'] - 1,
+           'started on core', core, '(attempt %d)' % unit['attempts'])
+    return process
+
+
+# ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
+
+
+def runUnits (units, executable, cores, maxAttempts):
+    '''hand out the units to the free cores until all are done or failed too many times'''
+    pending = list (units)
+    running = {}                    # core -> (unit, process)
+    freeCores = list (cores)
+
+    while pending or running :
+        while pending and freeCores :
+            core = freeCores.pop (0)
+            unit = pending.pop (0)
+            running[core] = (unit, startUnit (unit, executable, core))
+
+        time.sleep (0.2)
+        for core in list (running.keys ()) :
+            unit, process = running[core]
+            status = process.poll ()
+            if status is None :
+                continue
+            del running[core]
+            freeCores.append (core)
+            unit['wallTime'] = time.time () - unit['start']
+            unit['exitCode'] = status
+            if status == 0 and os.path.isfile (unit['output'] + '.root') :
+                unit['status'] = 'done'
+                print ('unit', unit['index'], 'done in %.1f s' % unit['wallTime'])
+            elif unit['attempts'] < maxAttempts :
+                print ('unit', unit['index'], 'failed with status', status, ', retrying, see', unit['log'])
+                pending.append (unit)
+            else :
+                unit['status'] = 'failed'
+                print ('unit', unit['index'], 'failed', unit['attempts'], 'times, see', unit['log'])
+
+    return all (unit['status'] == 'done' for unit in units)
 
 
 # ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ---- ----
@@ -26,13 +188,88 @@ def prepareJob (jobID):
 
 if __name__ == '__main__':
 
-    if len (sys.argv) < 2 : 
-        print 'usage :', sys.argv[0], 'jobsNumber','\n'
-        exit (1)
-    jobsNum = int (sys.argv[1])
-        
-    print 'submitting', jobsNum, 'jobs'
-        
-    for i in range (0, jobsNum):
-        prepareJob (str (i))    
+    parser = argparse.ArgumentParser (description = 'run a Shashlik sample on the local cores')
+    parser.add_argument ('output', help = 'output name, the merged sample goes to <output>.root')
+    parser.add_argument ('-c', '--config', default = 'config.cfg', help = 'configuration file')
+    parser.add_argument ('-m', '--macro', default = 'gps.mac', help = 'macro file, with one /run/beamOn')
+    parser.add_argument ('-n', '--events', type = int, default = None, help = 'events in total (default: from the macro)')
+    parser.add_argument ('-u', '--unit', type = int, default = 100, help = 'events per work unit')
+    parser.add_argument ('-j', '--jobs', type = int, default = None, help = 'parallel jobs (default: available cores)')
+    parser.add_argument ('-s', '--seed', type = int, default = None, help = 'master seed (default: from the time)')
+    parser.add_argument ('-r', '--retries', type = int, default = 2, help = 'retries of a failed unit')
+    parser.add_argument ('-w', '--workdir', default = None, help = 'directory of the units (default: <output>_units)')
+    parser.add_argument ('-e', '--exe', default = None, help = 'Shashlik executable')
+    parser.add_argument ('-k', '--keep', action = 'store_true', help = 'keep the units directories')
+    args = parser.parse_args ()
+
+    executable = args.exe if args.exe else findExecutable ('Shashlik')
+    if not executable :
+        print ('Shashlik executable not found, use --exe')
+        sys.exit (1)
+    executable = os.path.abspath (executable)
+
+    configLines = open (args.config).readlines ()
+    macroLines = open (args.macro).readlines ()
+    nEvents = args.events if args.events is not None else readEvents (macroLines)
+    if nEvents is None or nEvents <= 0 or args.unit <= 0 :
+        print ('the macro', args.macro, 'needs exactly one /run/beamOn, or give the events with --events')
+        sys.exit (1)
+
+    # same range of the seeds created by Shashlik
+    seed = args.seed if args.seed is not None else int (time.time () * 1000 + os.getpid ()) % 899999999 + 1
+
+    if hasattr (os, 'sched_getaffinity') :
+        cores = sorted (os.sched_getaffinity (0))
+    else :
+        cores = list (range (os.sysconf ('SC_NPROCESSORS_ONLN')))
+    if args.jobs :
+        cores = cores[:args.jobs]
+
+    output = os.path.abspath (args.output)
+    workDir = os.path.abspath (args.workdir if args.workdir else output + '_units')
+
+    units = []
+    for firstEvent in range (0, nEvents, args.unit) :
+        unit = {'index' : len (units), 'firstEvent' : firstEvent, 'nEvents' : min (args.unit, nEvents - firstEvent),
+                'attempts' : 0, 'status' : 'pending'}
+        prepareUnit (unit, workDir, configLines, macroLines, seed)
+        units.append (unit)
+
+    print ('running', nEvents, 'events in', len (units), 'units on', len (cores), 'cores, master seed', seed)
+    startTime = time.time ()
+    success = runUnits (units, executable, cores, args.retries + 1)
+
+    if success :
+        # the units are in event order, the merge concatenates them
+        command = [executable, '--merge', output + '.root'] + [unit['output'] + '.root' for unit in units]
+        mergeLog = open (os.path.join (workDir, 'merge_log.txt'), 'w')
+        success = (subprocess.call (command, stdout = mergeLog, stderr = subprocess.STDOUT) == 0)
+        mergeLog.close ()
+        if not success :
+            print ('merge failed, see', os.path.join (workDir, 'merge_log.txt'))
+
+    manifest = {
+        'output'     : output + '.root' if success else None,
+        'success'    : success,
+        'host'       : socket.gethostname (),
+        'executable' : executable,
+        'config'     : os.path.abspath (args.config),
+        'macro'      : os.path.abspath (args.macro),
+        'masterSeed' : seed,
+        'events'     : nEvents,
+        'cores'      : cores,
+        'start'      : time.strftime ('%Y-%m-%d %H:%M:%S', time.localtime (startTime)),
+        'wallTime'   : time.time () - startTime,
+        'units'      : [dict ((key, unit.get (key)) for key in
+                             ('index', 'firstEvent', 'nEvents', 'status', 'attempts', 'core', 'exitCode', 'wallTime', 'dir'))
+                        for unit in units],
+    }
+    f = open (output + '_manifest.json', 'w')
+    json.dump (manifest, f, indent = 2)
+    f.close ()
+    print ('manifest written to', output + '_manifest.json')
+
+    if success and not args.keep :
+        shutil.rmtree (workDir)
 
+    sys.exit (0 if success else 1)